@@ -0,0 +1,75 @@
+var bench = require('./support/bench');
+var uv = require('uv');
+
+var loop = uv.default_loop();
+
+// connections per second through connect, accept and close on both ends
+// a fixed number of connects is kept in flight
+
+var connections = 5000;
+var concurrency = 16;
+
+var accept = function(name, port, listen) {
+    bench('accept/' + name, function(done) {
+        var addr = { address: '127.0.0.1', port: port, family: 'IPv4' };
+
+        var server = uv.tcp_init(loop);
+        server.bind(addr);
+
+        var closed = function() {};
+        listen(server, function(client) {
+            client.close(closed);
+        });
+
+        var started = 0;
+        var finished = 0;
+        var start = uv.hrtime();
+
+        var connect = function() {
+            if (started === connections) {
+                return;
+            }
+
+            ++started;
+
+            var client = uv.tcp_init(loop);
+            client.connect(addr, function() {
+                client.close(function() {
+                    if (++finished < connections) {
+                        return connect();
+                    }
+
+                    var elapsed = uv.hrtime() - start;
+                    server.close(function() {
+                        done({
+                            connections: connections,
+                            concurrency: concurrency,
+                            ns_per_connection: elapsed / connections,
+                            per_sec: connections / (elapsed / 1e9)
+                        });
+                    });
+                });
+            });
+        };
+
+        for (var i=0 ; i<concurrency ; ++i) {
+            connect();
+        }
+    });
+};
+
+// one js callback per connection
+accept('listen', 9101, function(server, on_client) {
+    server.listen(128, function() {
+        on_client(server.accept());
+    });
+});
+
+// accepted natively, one js callback per loop iteration
+accept('listen_all', 9102, function(server, on_client) {
+    server.listen_all(128, function(status, clients) {
+        for (var i=0 ; i<clients.length ; ++i) {
+            on_client(clients[i]);
+        }
+    });
+});
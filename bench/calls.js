@@ -0,0 +1,95 @@
+var bench = require('./support/bench');
+var uv = require('uv');
+
+// cost of crossing from js into a binding
+// noop is an empty native function, the difference to it is the binding's own work
+
+var loop = uv.default_loop();
+var iterations = 1000000;
+
+var calls = function(name, setup) {
+    bench('calls/' + name, function(done) {
+        var ctx = setup();
+
+        var elapsed = bench.time(iterations, ctx.fn);
+
+        var finish = function() {
+            done({ iterations: iterations, ns_per_call: elapsed / iterations });
+        };
+
+        if (ctx.handle) {
+            return ctx.handle.close(finish);
+        }
+
+        finish();
+    });
+};
+
+calls('noop', function() {
+    return { fn: function() { noop(); } };
+});
+
+calls('hrtime', function() {
+    return { fn: function() { uv.hrtime(); } };
+});
+
+calls('now', function() {
+    return { fn: function() { uv.now(loop); } };
+});
+
+calls('update_time', function() {
+    return { fn: function() { uv.update_time(loop); } };
+});
+
+calls('backend_timeout', function() {
+    return { fn: function() { uv.backend_timeout(loop); } };
+});
+
+calls('err_name', function() {
+    return { fn: function() { uv.err_name(-2); } };
+});
+
+calls('timer.start_stop', function() {
+    var timer = uv.timer_init(loop);
+    var cb = function() {};
+
+    return {
+        handle: timer,
+        fn: function() {
+            timer.start(1000, 0, cb);
+            timer.stop();
+        }
+    };
+});
+
+calls('timer_wheel.add_cancel', function() {
+    var wheel = uv.timer_wheel_init(loop, function() {});
+
+    return {
+        handle: wheel,
+        fn: function() {
+            wheel.cancel(wheel.add(1000, 0));
+        }
+    };
+});
+
+calls('tcp.write_queue_size', function() {
+    var tcp = uv.tcp_init(loop);
+
+    return {
+        handle: tcp,
+        fn: function() { tcp.write_queue_size(); }
+    };
+});
+
+calls('tcp.cork_uncork', function() {
+    var tcp = uv.tcp_init(loop);
+
+    return {
+        handle: tcp,
+        fn: function() {
+            tcp.cork();
+            tcp.uncork();
+        }
+    };
+});
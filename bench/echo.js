@@ -0,0 +1,136 @@
+var bench = require('./support/bench');
+var uv = require('uv');
+
+var loop = uv.default_loop();
+
+var addr = { address: '127.0.0.1', port: 9100, family: 'IPv4' };
+var sizes = [64, 1024, 16 * 1024, 64 * 1024];
+
+// echo server, writes back every read as it arrives
+var server;
+
+var listen = function() {
+    server = uv.tcp_init(loop);
+    server.bind(addr);
+    server.listen(128, function() {
+        var client = server.accept();
+        var written = function() {};
+
+        client.read_start(function(err, data) {
+            if (err || !data) {
+                return client.close(function() {});
+            }
+
+            client.write(data, written);
+        });
+    });
+};
+
+// client connected to the echo server, on_data gets the number of bytes read
+var connect = function(on_data, cb) {
+    var client = uv.tcp_init(loop);
+    client.connect(addr, function() {
+        client.read_start(function(err, data) {
+            if (err || !data) {
+                return;
+            }
+
+            on_data(data.byteLength);
+        });
+
+        cb(client);
+    });
+};
+
+bench('echo/listen', function(done) {
+    listen();
+    done();
+});
+
+// one message in flight, round trip time per message
+sizes.forEach(function(size) {
+    bench('echo/latency/' + size, function(done) {
+        var count = size < 16 * 1024 ? 10000 : 2000;
+        var message = new ArrayBuffer(size);
+        var samples = [];
+
+        var client;
+        var received = 0;
+        var sent_at;
+
+        var send = function() {
+            received = 0;
+            sent_at = uv.hrtime();
+            client.write(message, function() {});
+        };
+
+        connect(function(nread) {
+            received += nread;
+            if (received < size) {
+                return;
+            }
+
+            samples.push(uv.hrtime() - sent_at);
+            if (samples.length < count) {
+                return send();
+            }
+
+            client.close(function() {
+                var result = bench.summary(samples);
+                result.size = size;
+                done(result);
+            });
+        }, function(c) {
+            client = c;
+            send();
+        });
+    });
+});
+
+// keep a window of bytes in flight, bytes echoed per second
+sizes.forEach(function(size) {
+    bench('echo/throughput/' + size, function(done) {
+        var total = 64 * 1024 * 1024;
+        var window = 1024 * 1024;
+        var message = new ArrayBuffer(size);
+
+        var client;
+        var sent = 0;
+        var received = 0;
+        var start;
+
+        var fill = function() {
+            while (sent < total && sent - received < window) {
+                client.write(message, function() {});
+                sent += size;
+            }
+        };
+
+        connect(function(nread) {
+            received += nread;
+            if (received < total) {
+                return fill();
+            }
+
+            var elapsed = uv.hrtime() - start;
+            client.close(function() {
+                done({
+                    size: size,
+                    bytes: total,
+                    ns: elapsed,
+                    mb_per_sec: (total / (1024 * 1024)) / (elapsed / 1e9)
+                });
+            });
+        }, function(c) {
+            client = c;
+            start = uv.hrtime();
+            fill();
+        });
+    });
+});
+
+bench('echo/close', function(done) {
+    server.close(function() {
+        done();
+    });
+});
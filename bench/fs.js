@@ -0,0 +1,97 @@
+var bench = require('./support/bench');
+var uv = require('uv');
+
+var loop = uv.default_loop();
+
+// whole file reads from the page cache, sync and on the threadpool
+// every read of a benchmark goes into the same buffer
+
+var files = {
+    small: { path: './test/support/fs/foo.txt', buffer: 4096, iterations: 20000 },
+    large: { path: './test/support/encoding-indexes.js', buffer: 1024 * 1024, iterations: 500 }
+};
+
+var result = function(file, bytes, elapsed) {
+    return {
+        reads: file.iterations,
+        bytes: bytes,
+        ns_per_read: elapsed / file.iterations,
+        mb_per_sec: (bytes / (1024 * 1024)) / (elapsed / 1e9)
+    };
+};
+
+Object.keys(files).forEach(function(size) {
+    var file = files[size];
+
+    bench('fs_read/sync/' + size, function(done) {
+        var fd = uv.fs_open(loop, file.path, 0, 0, null);
+        var buf = new ArrayBuffer(file.buffer);
+
+        var bytes = 0;
+        var start = uv.hrtime();
+        for (var i=0 ; i<file.iterations ; ++i) {
+            bytes += uv.fs_read(loop, fd, buf, 0, null);
+        }
+        var elapsed = uv.hrtime() - start;
+
+        uv.fs_close(loop, fd, null);
+        done(result(file, bytes, elapsed));
+    });
+
+    // one read in flight at a time, measures the threadpool round trip
+    bench('fs_read/async/' + size, function(done) {
+        var fd = uv.fs_open(loop, file.path, 0, 0, null);
+        var buf = new ArrayBuffer(file.buffer);
+
+        var bytes = 0;
+        var remaining = file.iterations;
+        var start = uv.hrtime();
+
+        var next = function() {
+            uv.fs_read(loop, fd, buf, 0, function(err, nread) {
+                if (err) {
+                    throw err;
+                }
+
+                bytes += nread;
+                if (--remaining > 0) {
+                    return next();
+                }
+
+                var elapsed = uv.hrtime() - start;
+                uv.fs_close(loop, fd, null);
+                done(result(file, bytes, elapsed));
+            });
+        };
+
+        next();
+    });
+});
+
+// open, fstat, read and close in a single request
+Object.keys(files).forEach(function(size) {
+    var file = files[size];
+
+    bench('fs_read_file/async/' + size, function(done) {
+        var bytes = 0;
+        var remaining = file.iterations;
+        var start = uv.hrtime();
+
+        var next = function() {
+            uv.fs_read_file(loop, file.path, function(err, buf) {
+                if (err) {
+                    throw err;
+                }
+
+                bytes += buf.byteLength;
+                if (--remaining > 0) {
+                    return next();
+                }
+
+                done(result(file, bytes, uv.hrtime() - start));
+            });
+        };
+
+        next();
+    });
+});
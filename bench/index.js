@@ -0,0 +1,14 @@
+var uv = require('uv');
+
+// make bench
+//
+// one line of json per benchmark on stdout, see support/bench.js
+// everything runs over loopback on ports 9100-9199
+
+require('./calls');
+require('./timer');
+require('./fs');
+require('./echo');
+require('./accept');
+
+uv.run(uv.default_loop(), uv.UV_RUN_DEFAULT);
@@ -0,0 +1,88 @@
+var uv = require('uv');
+
+// benchmarks run one after the other, each prints a single line of json
+//
+// bench(name, fn) queues fn(done), fn calls done(result) once it is finished.
+// result is an object of measurements, times are in nanoseconds unless the
+// key says otherwise. The printed line is the result plus name, so the output
+// of two commits can be compared line by line.
+
+var benches = [];
+var running = false;
+
+var next_bench = function() {
+    if (running) {
+        return;
+    }
+
+    var next = benches.shift();
+    if (!next) {
+        return;
+    }
+
+    running = true;
+
+    next.fn(function(result) {
+        result = result || {};
+
+        var out = { name: next.name };
+        for (var key in result) {
+            out[key] = result[key];
+        }
+
+        print(JSON.stringify(out));
+
+        running = false;
+        next_bench();
+    });
+};
+
+var bench = function(name, fn) {
+    benches.push({
+        name: name,
+        fn: fn
+    });
+
+    next_bench();
+};
+
+// time fn over iterations calls after a warm up, for synchronous benchmarks
+bench.time = function(iterations, fn) {
+    for (var i=0 ; i<iterations / 10 ; ++i) {
+        fn();
+    }
+
+    var start = uv.hrtime();
+    for (var i=0 ; i<iterations ; ++i) {
+        fn();
+    }
+
+    return uv.hrtime() - start;
+};
+
+// mean and percentiles of an array of samples, sorts samples
+bench.summary = function(samples) {
+    samples.sort(function(a, b) {
+        return a - b;
+    });
+
+    var sum = 0;
+    for (var i=0 ; i<samples.length ; ++i) {
+        sum += samples[i];
+    }
+
+    var at = function(p) {
+        return samples[Math.min(samples.length - 1, Math.floor(samples.length * p))];
+    };
+
+    return {
+        samples: samples.length,
+        mean: sum / samples.length,
+        min: samples[0],
+        p50: at(0.5),
+        p99: at(0.99),
+        max: samples[samples.length - 1]
+    };
+};
+
+return bench;
@@ -0,0 +1,80 @@
+var bench = require('./support/bench');
+var uv = require('uv');
+
+var loop = uv.default_loop();
+
+// create, start, stop and close a timer per iteration
+// includes the loop iterations needed to run the close callbacks
+bench('timer/churn', function(done) {
+    var count = 100000;
+    var closed = 0;
+    var cb = function() {};
+
+    var after_close = function() {
+        if (++closed < count) {
+            return;
+        }
+
+        var elapsed = uv.hrtime() - start;
+        done({ timers: count, ns_per_timer: elapsed / count });
+    };
+
+    var start = uv.hrtime();
+    for (var i=0 ; i<count ; ++i) {
+        var timer = uv.timer_init(loop);
+        timer.start(1000, 0, cb);
+        timer.stop();
+        timer.close(after_close);
+    }
+});
+
+// many timers expiring together, time until the last callback
+var fire = function(name, count, start_timers) {
+    bench('timer/fire/' + name, function(done) {
+        var fired = 0;
+        var start;
+
+        var on_fire = function() {
+            if (++fired < count) {
+                return;
+            }
+
+            var elapsed = uv.hrtime() - start;
+            done({ timers: count, ns_per_timer: elapsed / count });
+        };
+
+        start = uv.hrtime();
+        start_timers(count, on_fire);
+    });
+};
+
+fire('timer', 10000, function(count, on_fire) {
+    var closed = function() {};
+
+    for (var i=0 ; i<count ; ++i) {
+        var timer = uv.timer_init(loop);
+        timer.start(1, 0, function() {
+            this.close(closed);
+            on_fire();
+        }.bind(timer));
+    }
+});
+
+fire('wheel', 10000, function(count, on_fire) {
+    var fired = 0;
+
+    var wheel = uv.timer_wheel_init(loop, function(tokens) {
+        fired += tokens.length;
+        if (fired === count) {
+            wheel.close(function() {});
+        }
+
+        for (var i=0 ; i<tokens.length ; ++i) {
+            on_fire();
+        }
+    });
+
+    for (var i=0 ; i<count ; ++i) {
+        wheel.add(1, i);
+    }
+});
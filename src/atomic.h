@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+
+namespace uvjs {
+namespace detail {
+
+// minimal atomics for the lock-free queues shared between threads
+// loads acquire, stores release and exchange/add do both. A store followed by
+// a load of another variable can still be reordered, put AtomicFence between
+// them when both threads must see each other (Dekker style handshakes)
+
+#if defined(_MSC_VER)
+
+template <typename T>
+inline T* AtomicExchange(T* volatile* ptr, T* val) {
+    return static_cast<T*>(InterlockedExchangePointer(
+            reinterpret_cast<void* volatile*>(ptr), val));
+}
+
+inline long AtomicExchange(volatile long* ptr, long val) {
+    return InterlockedExchange(ptr, val);
+}
+
+inline long AtomicAdd(volatile long* ptr, long val) {
+    return InterlockedExchangeAdd(ptr, val) + val;
+}
+
+// volatile accesses have acquire/release semantics with msvc
+template <typename T>
+inline T AtomicLoad(volatile T* ptr) {
+    return *ptr;
+}
+
+template <typename T>
+inline void AtomicStore(volatile T* ptr, T val) {
+    *ptr = val;
+}
+
+inline void AtomicFence() {
+    MemoryBarrier();
+}
+
+#else
+
+template <typename T>
+inline T* AtomicExchange(T* volatile* ptr, T* val) {
+    return __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL);
+}
+
+inline long AtomicExchange(volatile long* ptr, long val) {
+    return __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL);
+}
+
+inline long AtomicAdd(volatile long* ptr, long val) {
+    return __atomic_add_fetch(ptr, val, __ATOMIC_ACQ_REL);
+}
+
+template <typename T>
+inline T AtomicLoad(volatile T* ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+inline void AtomicStore(volatile T* ptr, T val) {
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+inline void AtomicFence() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+} // namespace detail
+} // namespace uvjs
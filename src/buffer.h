@@ -0,0 +1,134 @@
+#pragma once
+
+#include <assert.h>
+#include <v8.h>
+#include <uv.h>
+
+#include <vector>
+
+#include "internal.h"
+#include "mapped_files.h"
+
+namespace uvjs {
+namespace detail {
+
+// true if the value can be used as a source or destination of bytes
+inline bool IsBuffer(v8::Local<v8::Value> val) {
+    return val->IsArrayBuffer() || val->IsArrayBufferView();
+}
+
+// point buf at the memory behind an ArrayBuffer or ArrayBufferView
+// views reference a window of their backing ArrayBuffer
+//
+// returns the backing ArrayBuffer, hold on to it for as long as buf is in use
+inline v8::Local<v8::ArrayBuffer> BufferContents(v8::Local<v8::Value> val, uv_buf_t* buf) {
+    assert(IsBuffer(val));
+    assert(uvjs::detail::allocator);
+
+    if (val->IsArrayBuffer()) {
+        v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(val);
+        buf->base = static_cast<char*>(uvjs::detail::allocator->Externalized(ab));
+        buf->len = ab->ByteLength();
+        return ab;
+    }
+
+    v8::Local<v8::ArrayBufferView> view = v8::Local<v8::ArrayBufferView>::Cast(val);
+    v8::Local<v8::ArrayBuffer> ab = view->Buffer();
+
+    char* base = static_cast<char*>(uvjs::detail::allocator->Externalized(ab));
+    buf->base = base + view->ByteOffset();
+    buf->len = view->ByteLength();
+    return ab;
+}
+
+// fill bufs from a single buffer or an array of buffers
+// returns the object which keeps the buffer memory alive
+inline v8::Local<v8::Object> WriteBuffers(v8::Local<v8::Value> val, std::vector<uv_buf_t>& bufs) {
+    if (!val->IsArray()) {
+        bufs.resize(1);
+        return BufferContents(val, &bufs[0]);
+    }
+
+    v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(val);
+
+    const uint32_t num_bufs = arr->Length();
+    bufs.resize(num_bufs);
+
+    // views may share a backing buffer, we hold on to each backing buffer
+    // instead of the user's array which could be modified during the write
+    v8::Local<v8::Array> backing = v8::Array::New(num_bufs);
+
+    for (uint32_t i = 0 ; i < num_bufs ; ++i) {
+        v8::Local<v8::Value> buf = arr->Get(i);
+        assert(IsBuffer(buf));
+
+        backing->Set(i, BufferContents(buf, &bufs[i]));
+    }
+
+    return backing;
+}
+
+// pin or unpin every ArrayBuffer in buffers while native code uses their memory
+// buffers is what BufferContents or WriteBuffers returned, or an array of those
+inline void PinBuffers(v8::Local<v8::Value> buffers, bool pin) {
+    if (buffers->IsArray()) {
+        v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(buffers);
+        for (uint32_t i = 0 ; i < arr->Length() ; ++i) {
+            PinBuffers(arr->Get(i), pin);
+        }
+        return;
+    }
+
+    v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(buffers);
+    if (pin) {
+        uvjs::detail::allocator->Pin(ab);
+    }
+    else {
+        uvjs::detail::allocator->Unpin(ab);
+    }
+}
+
+// skip the bytes of bufs which have already been written
+// returns the index of the first buffer with data left to write
+inline size_t ConsumeBuffers(std::vector<uv_buf_t>& bufs, size_t written) {
+    size_t idx = 0;
+    for (; idx < bufs.size() && written >= bufs[idx].len ; ++idx) {
+        written -= bufs[idx].len;
+    }
+
+    if (idx < bufs.size()) {
+        bufs[idx].base += written;
+        bufs[idx].len -= written;
+    }
+
+    return idx;
+}
+
+// move the memory of an ArrayBuffer out of its isolate
+// the buffer is neutered (zero length) and buf owns the memory afterwards,
+// hand it to allocator->Externalize in another isolate or allocator->Free it
+//
+// file mappings (fs_mmap) are not allocator memory and can't be transferred,
+// UV_EINVAL and the buffer is left as is. Neither can buffers native code
+// still uses (pending writes and reads, the read slab), UV_EBUSY.
+inline int TransferContents(v8::Local<v8::ArrayBuffer> ab, uv_buf_t* buf) {
+    assert(uvjs::detail::allocator);
+
+    Mapping mapping;
+    if (ab->IsExternal() &&
+            MappedFiles::Find(uvjs::detail::allocator->Externalized(ab), &mapping)) {
+        return UV_EINVAL;
+    }
+
+    if (uvjs::detail::allocator->Pinned(ab)) {
+        return UV_EBUSY;
+    }
+
+    buf->len = ab->ByteLength();
+    buf->base = static_cast<char*>(uvjs::detail::allocator->Release(ab));
+    ab->Neuter();
+    return 0;
+}
+
+} // namespace detail
+} // namespace uvjs
@@ -2,6 +2,8 @@
 
 #include <assert.h>
 
+#include "loop_metrics.h"
+
 namespace uvjs {
 namespace detail {
 
@@ -52,6 +54,8 @@ public:
         //v8::Local<v8::Function> fn = v8::Local<v8::Function>::New(isolate, handle);
         v8::Local<v8::Function> fn = PersistentToLocal(isolate, handle);
 
+        MetricsScope metrics;
+
         v8::TryCatch try_catch;
         try_catch.SetVerbose(true);
 
@@ -70,6 +74,8 @@ public:
         //v8::Local<v8::Function> fn = v8::Local<v8::Function>::New(isolate, handle);
         v8::Local<v8::Function> fn = PersistentToLocal(isolate, handle);
 
+        MetricsScope metrics;
+
         v8::TryCatch try_catch;
         try_catch.SetVerbose(true);
 
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <uv.h>
+
+namespace uvjs {
+namespace detail {
+
+// name of a handle type, as used in the uv_<name>_t struct
+inline const char* HandleTypeName(uv_handle_type type) {
+    switch (type) {
+#define XX(uc, lc) case UV_##uc: return #lc;
+    UV_HANDLE_TYPE_MAP(XX)
+#undef XX
+    default:
+        return "unknown";
+    }
+}
+
+} // namespace detail
+} // namespace uvjs
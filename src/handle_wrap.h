@@ -23,17 +23,66 @@
 
 #include <assert.h>
 #include <v8.h>
+#include <uv.h>
 
 #include "unwrap.h"
 #include "callback.h"
+#include "statics.h"
 
 namespace uvjs {
 namespace detail {
 
+// HandleBase links every live wrap of a thread into a list
+//
+// uv_walk only hands out uv_handle_t pointers and handle->data is not always
+// a wrap (loop hooks use it for their owner), the list tells them apart and
+// lets walk() report what a wrap holds on to without knowing its type
+class HandleBase {
+public:
+    HandleBase() : _prev(0) {
+        _next = ThreadLocal<HandleBase>::Get();
+        if (_next) {
+            _next->_prev = this;
+        }
+        ThreadLocal<HandleBase>::Set(this);
+    }
+
+    virtual ~HandleBase() {
+        if (_next) {
+            _next->_prev = _prev;
+        }
+
+        if (_prev) {
+            _prev->_next = _next;
+        }
+        else {
+            ThreadLocal<HandleBase>::Set(_next);
+        }
+    }
+
+    // first wrap created on this thread which is still alive
+    static HandleBase* First() {
+        return ThreadLocal<HandleBase>::Get();
+    }
+
+    HandleBase* next() const {
+        return _next;
+    }
+
+    virtual uv_handle_t* uv_handle() = 0;
+
+    // add what the wrap holds to info, must be called within a HandleScope
+    virtual void Describe(v8::Local<v8::Object> info) = 0;
+
+private:
+    HandleBase* _prev;
+    HandleBase* _next;
+};
+
 // object wraps a js handle for incrementing/decrementing the weak state
 // this is used when we need an object to live for a callback
 template <typename handle_t>
-class HandleWrap {
+class HandleWrap : public HandleBase {
 public:
     HandleWrap() : _handle(0), _refs(0) {
         _handle = new handle_t();
@@ -64,6 +113,16 @@ public:
     }
 
 
+    uv_handle_t* uv_handle() {
+        return reinterpret_cast<uv_handle_t*>(_handle);
+    }
+
+    void Describe(v8::Local<v8::Object> info) {
+        info->Set(v8::String::NewSymbol("refs"), v8::Integer::New(_refs));
+        info->Set(v8::String::NewSymbol("weak"), v8::Boolean::New(persistent().IsWeak()));
+        info->Set(v8::String::NewSymbol("close_cb"), v8::Boolean::New(!_close_cb.IsEmpty()));
+    }
+
     inline v8::Local<v8::Object> handle() {
         return handle(v8::Isolate::GetCurrent());
     }
@@ -135,11 +194,18 @@ public:
         wrap->close();
     }
 
+    // called once the handle has been closed, before any close callback
+    // subclasses use this to release native state tied to the open handle
+    virtual void Closed() {}
+
     // after calling close during normal operations
     static void After_close(uv_handle_t* handle) {
         v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+        MetricsPhase phase(LoopMetrics::kPhaseClose);
         HandleWrap<handle_t>* wrap = static_cast<HandleWrap<handle_t>* >(handle->data);
 
+        wrap->Closed();
+
         if (!wrap->close_callback().IsEmpty()) {
             wrap->Unref(); // unref for close
 
@@ -161,8 +227,11 @@ public:
     // different than normal operation since it requires cleanup of wrap
     static void After_death_close(uv_handle_t* handle) {
         v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+        MetricsPhase phase(LoopMetrics::kPhaseClose);
         HandleWrap<handle_t>* wrap = static_cast<HandleWrap<handle_t>* >(handle->data);
 
+        wrap->Closed();
+
         handle->data = NULL;
         delete wrap;
     }
@@ -9,5 +9,8 @@ namespace detail {
 // prior to any use of the uvjs bindings
 uvjs::ArrayBufferAllocator* allocator = 0;
 
+// builds the global object for worker contexts, optional
+uvjs::WorkerGlobalCallback worker_global = 0;
+
 } // namespace detail
 } // namespace uvjs
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <assert.h>
+#include <uv.h>
+
+namespace uvjs {
+namespace detail {
+
+class SlabAllocator;
+class CorkFlusher;
+class AcceptBatcher;
+class LoopMetrics;
+class LoopWatchdog;
+
+// LoopData holds the native state uvjs keeps for each loop
+//
+// it hangs off loop->data so lookups on hot paths (every read) are a pointer
+// chase instead of a map lookup, and loops running on different threads never
+// share any state. Members are created on first use by their owners.
+struct LoopData {
+    LoopData() : slab(0), cork_flusher(0), accept_batcher(0), metrics(0),
+        watchdog(0) {}
+
+    SlabAllocator* slab;
+    CorkFlusher* cork_flusher;
+    AcceptBatcher* accept_batcher;
+    LoopMetrics* metrics;
+    LoopWatchdog* watchdog;
+
+    static LoopData* Get(uv_loop_t* loop) {
+        if (!loop->data) {
+            loop->data = new LoopData();
+        }
+
+        return static_cast<LoopData*>(loop->data);
+    }
+};
+
+} // namespace detail
+} // namespace uvjs
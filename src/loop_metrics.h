@@ -0,0 +1,307 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <v8.h>
+#include <uv.h>
+
+#include "internal.h"
+#include "loop_data.h"
+#include "statics.h"
+
+namespace uvjs {
+namespace detail {
+
+// LoopMetrics records where a loop spends its time
+//
+// a prepare hook runs right before the loop polls and a check hook right after,
+// every js callback is timed on the way in and out (see MetricsScope). Timer and
+// close callbacks mark their phase on the way in (see MetricsPhase). Together
+// that splits each iteration into
+//  poll: time blocked in the backend waiting for events
+//  js poll: time in js callbacks for io events (inside the poll phase)
+//  js timer: time in js callbacks for timers, wheels and stream timeouts
+//  js check: time in js callbacks from check and prepare hooks (cork flushes)
+//  js close: time in js close callbacks
+//  lag: how late the poll returned compared to the timeout it was given
+//  callbacks: number of js callbacks in the iteration
+//
+// all values are microseconds (or counts) in a Float64Array shared with js,
+// reading it costs nothing. Counters come first, then one log-linear histogram
+// per value. Histogram buckets 0-7 hold the values 0-7, above that every power
+// of two is split into 8 buckets: bucket 8 + 8 * (e - 3) + m holds the values
+// from (8 + m) << (e - 3) up to the next bucket, the last bucket holds the rest.
+//
+// idle hooks are not used, an active idle handle stops the loop from blocking
+// in poll and would change what we are measuring.
+class LoopMetrics {
+public:
+    enum Counter {
+        kIterations,
+        kPollTime,
+        kJsPollTime,
+        kJsTimerTime,
+        kJsCheckTime,
+        kJsCloseTime,
+        kCallbacks,
+        kLagTime,
+        kCounterCount
+    };
+
+    enum Histogram {
+        kHistPoll,
+        kHistJsPoll,
+        kHistJsTimer,
+        kHistJsCheck,
+        kHistJsClose,
+        kHistLag,
+        kHistCallbacks,
+        kHistCount
+    };
+
+    // where js time is attributed
+    enum Phase {
+        kPhaseTimer,
+        kPhasePoll,
+        kPhaseCheck,
+        kPhaseClose,
+        kPhaseCount
+    };
+
+    static const int kBuckets = 240;
+    static const size_t kLength = kCounterCount + kHistCount * kBuckets;
+
+    LoopMetrics(uv_loop_t* loop) : _loop(loop), _in_poll(false), _phase(kPhaseCheck), _depth(0),
+        _prepare_time(0), _check_time(0), _timeout(-1), _callbacks(0) {
+
+        memset(_js_time, 0, sizeof(_js_time));
+
+        uv_prepare_init(loop, &_prepare);
+        _prepare.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_prepare));
+
+        uv_check_init(loop, &_check);
+        _check.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_check));
+
+        const size_t bytes = kLength * sizeof(double);
+        _values = static_cast<double*>(uvjs::detail::allocator->AllocateUninitialized(bytes));
+        memset(_values, 0, bytes);
+
+        // js owns the memory, we keep the buffer alive for as long as we write to it
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+        _buffer.Reset(v8::Isolate::GetCurrent(),
+                uvjs::detail::allocator->Externalize(_values, bytes));
+    }
+
+    ~LoopMetrics() {
+        if (Current() == this) {
+            ThreadLocal<LoopMetrics>::Set(0);
+        }
+
+        _buffer.Reset();
+    }
+
+    static LoopMetrics* ForLoop(uv_loop_t* loop) {
+        LoopData* data = LoopData::Get(loop);
+        if (!data->metrics) {
+            data->metrics = new LoopMetrics(loop);
+        }
+
+        return data->metrics;
+    }
+
+    // metrics of the loop being recorded on this thread
+    static LoopMetrics* Current() {
+        return ThreadLocal<LoopMetrics>::Get();
+    }
+
+    // start recording, must be called on the thread running the loop
+    void Start() {
+        ThreadLocal<LoopMetrics>::Set(this);
+        uv_prepare_start(&_prepare, After_Prepare);
+        uv_check_start(&_check, After_Check);
+    }
+
+    void Stop() {
+        if (Current() == this) {
+            ThreadLocal<LoopMetrics>::Set(0);
+        }
+
+        uv_prepare_stop(&_prepare);
+        uv_check_stop(&_check);
+    }
+
+    // release the hooks, the loop must run once more before we are deleted
+    void Close() {
+        Stop();
+        uv_close(reinterpret_cast<uv_handle_t*>(&_prepare), NULL);
+        uv_close(reinterpret_cast<uv_handle_t*>(&_check), NULL);
+    }
+
+    // live view of the values, must be called within a HandleScope
+    v8::Local<v8::Float64Array> snapshot() {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        v8::Local<v8::ArrayBuffer> buffer = v8::Local<v8::ArrayBuffer>::New(isolate, _buffer);
+        return v8::Float64Array::New(buffer, 0, kLength);
+    }
+
+    // a js callback is about to run, nested callbacks are part of the outer one
+    inline uint64_t Enter() {
+        return _depth++ == 0 ? uv_hrtime() : 0;
+    }
+
+    inline void Exit(uint64_t start) {
+        if (--_depth > 0) {
+            return;
+        }
+
+        _js_time[_phase] += uv_hrtime() - start;
+        ++_callbacks;
+    }
+
+    // callbacks from now on run in phase, returns the phase to restore
+    inline Phase SetPhase(Phase phase) {
+        const Phase previous = _phase;
+        _phase = phase;
+        return previous;
+    }
+
+private:
+    static int Bucket(uint64_t value) {
+        if (value < 8) {
+            return value;
+        }
+
+        int e = 3;
+        while (value >> (e + 1)) {
+            ++e;
+        }
+
+        const int bucket = 8 + 8 * (e - 3) + ((value >> (e - 3)) & 7);
+        return bucket < kBuckets ? bucket : kBuckets - 1;
+    }
+
+    void Record(Counter counter, Histogram histogram, uint64_t value) {
+        _values[counter] += value;
+        _values[kCounterCount + histogram * kBuckets + Bucket(value)] += 1;
+    }
+
+    // the previous iteration is over, the loop is about to poll
+    static void After_Prepare(uv_prepare_t* handle, int status) {
+        LoopMetrics* metrics = static_cast<LoopMetrics*>(handle->data);
+        const uint64_t now = uv_hrtime();
+
+        if (metrics->_check_time) {
+            metrics->Record(kJsTimerTime, kHistJsTimer, metrics->_js_time[kPhaseTimer] / 1000);
+            metrics->Record(kJsCheckTime, kHistJsCheck, metrics->_js_time[kPhaseCheck] / 1000);
+            metrics->Record(kJsCloseTime, kHistJsClose, metrics->_js_time[kPhaseClose] / 1000);
+            metrics->Record(kCallbacks, kHistCallbacks, metrics->_callbacks);
+            metrics->_values[kIterations] += 1;
+        }
+
+        memset(metrics->_js_time, 0, sizeof(metrics->_js_time));
+        metrics->_callbacks = 0;
+
+        metrics->_in_poll = true;
+        metrics->_phase = kPhasePoll;
+        metrics->_prepare_time = now;
+        metrics->_timeout = uv_backend_timeout(metrics->_loop);
+    }
+
+    // the poll returned and its io callbacks ran
+    static void After_Check(uv_check_t* handle, int status) {
+        LoopMetrics* metrics = static_cast<LoopMetrics*>(handle->data);
+        const uint64_t now = uv_hrtime();
+
+        if (!metrics->_in_poll) {
+            return;
+        }
+
+        const uint64_t elapsed = now - metrics->_prepare_time;
+        const uint64_t js = metrics->_js_time[kPhasePoll];
+
+        // time spent blocked in the kernel, io callbacks are js time
+        const uint64_t poll = elapsed > js ? elapsed - js : 0;
+
+        metrics->Record(kPollTime, kHistPoll, poll / 1000);
+        metrics->Record(kJsPollTime, kHistJsPoll, js / 1000);
+
+        // only blocking longer than the timeout asked for is lag
+        uint64_t lag = 0;
+        if (metrics->_timeout >= 0) {
+            const uint64_t expected = static_cast<uint64_t>(metrics->_timeout) * 1000000;
+            lag = poll > expected ? poll - expected : 0;
+        }
+        metrics->Record(kLagTime, kHistLag, lag / 1000);
+
+        metrics->_in_poll = false;
+        metrics->_phase = kPhaseCheck;
+        metrics->_check_time = now;
+    }
+
+    uv_loop_t* _loop;
+    uv_prepare_t _prepare;
+    uv_check_t _check;
+
+    double* _values;
+    v8::Persistent<v8::ArrayBuffer> _buffer;
+
+    bool _in_poll;
+
+    // js time in ns for this iteration, indexed by Phase
+    Phase _phase;
+    int _depth;
+    uint64_t _js_time[kPhaseCount];
+
+    uint64_t _prepare_time;
+    uint64_t _check_time;
+    int _timeout;
+    uint64_t _callbacks;
+};
+
+// times the js callback running for its lifetime if metrics are being recorded
+class MetricsScope {
+public:
+    MetricsScope() : _metrics(LoopMetrics::Current()), _start(0) {
+        if (_metrics) {
+            _start = _metrics->Enter();
+        }
+    }
+
+    ~MetricsScope() {
+        if (_metrics) {
+            _metrics->Exit(_start);
+        }
+    }
+
+private:
+    LoopMetrics* _metrics;
+    uint64_t _start;
+};
+
+// attributes the js callbacks run during its lifetime to phase
+// for native callbacks which are not told apart by the loop hooks
+class MetricsPhase {
+public:
+    MetricsPhase(LoopMetrics::Phase phase)
+        : _metrics(LoopMetrics::Current()), _previous(LoopMetrics::kPhaseCheck) {
+        if (_metrics) {
+            _previous = _metrics->SetPhase(phase);
+        }
+    }
+
+    ~MetricsPhase() {
+        if (_metrics) {
+            _metrics->SetPhase(_previous);
+        }
+    }
+
+private:
+    LoopMetrics* _metrics;
+    LoopMetrics::Phase _previous;
+};
+
+} // namespace detail
+} // namespace uvjs
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <v8.h>
+#include <uv.h>
+
+#include <map>
+#include <string>
+#include <sstream>
+
+#include "atomic.h"
+#include "callback.h"
+#include "handle_type.h"
+#include "loop_data.h"
+
+namespace uvjs {
+namespace detail {
+
+// LoopWatchdog reports a loop which stopped making progress
+//
+// a thread wakes the loop every half timeout through an unref'd async handle,
+// the loop records a heartbeat when it handles the wakeup and before every poll.
+// an idle loop wakes up and beats, a loop stuck in a callback does not.
+//
+// once the heartbeat is older than the timeout the isolate is interrupted.
+// the interrupt runs on the loop thread as soon as js executes and writes the
+// current js stack and a summary of the handles on the loop to stderr. The same
+// report is passed to the js callback once the loop is running again.
+//
+// the watchdog can't tell a stuck loop from one which is not being run at all,
+// stop it before leaving the loop.
+class LoopWatchdog {
+public:
+    LoopWatchdog(uv_loop_t* loop, uint64_t timeout_ms)
+        : _loop(loop), _isolate(v8::Isolate::GetCurrent()),
+        _timeout(timeout_ms * 1000000), _heartbeat(uv_hrtime()),
+        _stopping(false), _stalled(false), _interrupt_pending(0),
+        _dispose_on_interrupt(false), _closing(0) {}
+
+    static LoopWatchdog* ForLoop(uv_loop_t* loop) {
+        return LoopData::Get(loop)->watchdog;
+    }
+
+    Callback& callback() {
+        return _cb;
+    }
+
+    int Start() {
+        int err = uv_async_init(_loop, &_ping, After_Ping);
+        if (err) {
+            return err;
+        }
+
+        _ping.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_ping));
+
+        uv_prepare_init(_loop, &_prepare);
+        _prepare.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_prepare));
+        uv_prepare_start(&_prepare, After_Prepare);
+
+        uv_mutex_init(&_lock);
+        uv_cond_init(&_cond);
+
+        err = uv_thread_create(&_thread, Run, this);
+        assert(err == 0);
+
+        LoopData::Get(_loop)->watchdog = this;
+        return 0;
+    }
+
+    // stop the thread and close our handles, we are deleted once they closed
+    // (or once a report requested before that ran)
+    void Stop() {
+        uv_mutex_lock(&_lock);
+        _stopping = true;
+        uv_cond_signal(&_cond);
+        uv_mutex_unlock(&_lock);
+
+        uv_thread_join(&_thread);
+
+        uv_mutex_destroy(&_lock);
+        uv_cond_destroy(&_cond);
+
+        LoopData::Get(_loop)->watchdog = 0;
+
+        _closing = 2;
+        uv_close(reinterpret_cast<uv_handle_t*>(&_ping), After_Close);
+        uv_close(reinterpret_cast<uv_handle_t*>(&_prepare), After_Close);
+    }
+
+private:
+    void Beat() {
+        AtomicStore(&_heartbeat, uv_hrtime());
+    }
+
+    // watchdog thread
+    static void Run(void* arg) {
+        LoopWatchdog* watchdog = static_cast<LoopWatchdog*>(arg);
+
+        uv_mutex_lock(&watchdog->_lock);
+
+        while (!watchdog->_stopping) {
+            uv_cond_timedwait(&watchdog->_cond, &watchdog->_lock, watchdog->_timeout / 2);
+            if (watchdog->_stopping) {
+                break;
+            }
+
+            uv_async_send(&watchdog->_ping);
+
+            const uint64_t since = uv_hrtime() - AtomicLoad(&watchdog->_heartbeat);
+            if (since < watchdog->_timeout) {
+                watchdog->_stalled = false;
+                continue;
+            }
+
+            // report each stall once
+            if (watchdog->_stalled) {
+                continue;
+            }
+
+            watchdog->_stalled = true;
+            AtomicStore(&watchdog->_interrupt_pending, 1L);
+            watchdog->_isolate->RequestInterrupt(Interrupt, watchdog);
+        }
+
+        uv_mutex_unlock(&watchdog->_lock);
+    }
+
+    static void After_Ping(uv_async_t* handle, int status) {
+        LoopWatchdog* watchdog = static_cast<LoopWatchdog*>(handle->data);
+        watchdog->Beat();
+
+        // hand the report of the last stall to js now that we are running again
+        if (watchdog->_report.empty() || watchdog->_cb.IsEmpty()) {
+            return;
+        }
+
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+
+        const int argc = 1;
+        v8::Local<v8::Value> argv[argc] = { v8::String::New(watchdog->_report.c_str()) };
+        watchdog->_report.clear();
+
+        watchdog->_cb.Call(argc, argv);
+    }
+
+    static void After_Prepare(uv_prepare_t* handle, int status) {
+        static_cast<LoopWatchdog*>(handle->data)->Beat();
+    }
+
+    static void After_Close(uv_handle_t* handle) {
+        LoopWatchdog* watchdog = static_cast<LoopWatchdog*>(handle->data);
+        if (--watchdog->_closing > 0) {
+            return;
+        }
+
+        // v8 still holds our pointer for the interrupt
+        if (AtomicLoad(&watchdog->_interrupt_pending)) {
+            watchdog->_dispose_on_interrupt = true;
+            return;
+        }
+
+        delete watchdog;
+    }
+
+    // runs on the loop thread while the loop is stuck in js
+    static void Interrupt(v8::Isolate* isolate, void* data) {
+        LoopWatchdog* watchdog = static_cast<LoopWatchdog*>(data);
+        AtomicStore(&watchdog->_interrupt_pending, 0L);
+
+        if (watchdog->_dispose_on_interrupt) {
+            delete watchdog;
+            return;
+        }
+
+        v8::HandleScope scope(isolate);
+
+        const uint64_t since = uv_hrtime() - AtomicLoad(&watchdog->_heartbeat);
+
+        std::ostringstream report;
+        report << "loop blocked for " << since / 1000000 << "ms\n";
+
+        v8::Local<v8::StackTrace> trace = v8::StackTrace::CurrentStackTrace(32);
+        for (int i = 0 ; i < trace->GetFrameCount() ; ++i) {
+            v8::Local<v8::StackFrame> frame = trace->GetFrame(i);
+            v8::String::Utf8Value fn(frame->GetFunctionName());
+            v8::String::Utf8Value script(frame->GetScriptName());
+
+            report << "    at " << (fn.length() ? *fn : "<anonymous>")
+                << " (" << (*script ? *script : "<unknown>")
+                << ":" << frame->GetLineNumber() << ":" << frame->GetColumn() << ")\n";
+        }
+
+        // count handles by type and state
+        std::map<std::string, size_t> handles;
+        uv_walk(watchdog->_loop, CountHandle, &handles);
+
+        report << "handles:\n";
+        for (std::map<std::string, size_t>::iterator it = handles.begin() ; it != handles.end() ; ++it) {
+            report << "    " << it->first << ": " << it->second << "\n";
+        }
+
+        watchdog->_report = report.str();
+        fprintf(stderr, "%s", watchdog->_report.c_str());
+    }
+
+    static void CountHandle(uv_handle_t* handle, void* arg) {
+        std::map<std::string, size_t>* handles = static_cast<std::map<std::string, size_t>*>(arg);
+
+        std::string key = HandleTypeName(handle->type);
+        key += uv_is_active(handle) ? " active" : " inactive";
+        if (!uv_has_ref(handle)) {
+            key += " unref";
+        }
+        if (uv_is_closing(handle)) {
+            key += " closing";
+        }
+
+        ++(*handles)[key];
+    }
+
+    uv_loop_t* _loop;
+    v8::Isolate* _isolate;
+
+    uint64_t _timeout;
+    volatile uint64_t _heartbeat;
+
+    uv_thread_t _thread;
+    uv_mutex_t _lock;
+    uv_cond_t _cond;
+    bool _stopping;
+    bool _stalled;
+
+    uv_async_t _ping;
+    uv_prepare_t _prepare;
+
+    // set by the thread, cleared by the interrupt
+    volatile long _interrupt_pending;
+
+    // loop thread only
+    bool _dispose_on_interrupt;
+    int _closing;
+    std::string _report;
+
+    Callback _cb;
+};
+
+} // namespace detail
+} // namespace uvjs
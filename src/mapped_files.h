@@ -0,0 +1,67 @@
+#pragma once
+
+#include <assert.h>
+#include <uv.h>
+
+#include <map>
+
+#include "statics.h"
+
+namespace uvjs {
+namespace detail {
+
+struct Mapping {
+    void* base;
+    size_t len;
+};
+
+// MappedFiles maps the data of a mapped ArrayBuffer back to its mapping
+//
+// mmap works in whole pages, the buffer starts wherever the requested position
+// fell in the first page. It also tells mapped buffers apart from allocator
+// memory for fs_munmap and fs_madvise, and keeps mappings from being
+// transferred to another isolate whose allocator would free them. Buffers
+// live on different threads (workers), so the map is shared and locked.
+class MappedFiles : private StaticMutex<MappedFiles> {
+public:
+    static void Add(void* data, const Mapping& mapping) {
+        Lock();
+        _mappings[data] = mapping;
+        Unlock();
+    }
+
+    static bool Find(void* data, Mapping* mapping) {
+        Lock();
+
+        std::map<void*, Mapping>::iterator it = _mappings.find(data);
+        const bool found = it != _mappings.end();
+        if (found) {
+            *mapping = it->second;
+        }
+
+        Unlock();
+        return found;
+    }
+
+    static bool Remove(void* data, Mapping* mapping) {
+        Lock();
+
+        std::map<void*, Mapping>::iterator it = _mappings.find(data);
+        const bool found = it != _mappings.end();
+        if (found) {
+            *mapping = it->second;
+            _mappings.erase(it);
+        }
+
+        Unlock();
+        return found;
+    }
+
+private:
+    static std::map<void*, Mapping> _mappings;
+};
+
+std::map<void*, Mapping> MappedFiles::_mappings;
+
+} // namespace detail
+} // namespace uvjs
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <assert.h>
+#include <v8.h>
+#include <uv.h>
+
+#include <vector>
+
+#include "internal.h"
+#include "loop_data.h"
+
+namespace uvjs {
+namespace detail {
+
+// SlabAllocator carves stream reads out of large shared slabs
+//
+// libuv asks for 64k on every read, even if only a handful of bytes arrive.
+// Instead of a fresh allocation (and a fresh externalized ArrayBuffer) per read
+// we hand libuv the unused tail of the current slab and return a right sized
+// Uint8Array view over the slab once we know how many bytes were read.
+//
+// The slab memory is externalized through the embedder allocator the first time
+// a read is committed to it, with Recycle as its release callback. Once the
+// slab is full we forget about it. When the last view on it is collected the
+// allocator hands the memory back through Recycle and the slab goes on a short
+// free list for the next rotation instead of back to malloc.
+//
+// Slabs are pinned for good, they hold the reads of many streams and can't be
+// transferred (send a copy of the view instead). For the same reason a view's
+// .buffer shows the bytes of other reads on the loop.
+//
+// A view keeps its whole slab from being recycled. Streams which hold on to
+// small reads for long (partial requests on idle keep-alive connections)
+// should copy them, otherwise a few bytes can keep a whole slab alive.
+//
+// There is one slab allocator per loop. libuv calls alloc and read back to back
+// so there is never more than one outstanding allocation per loop.
+class SlabAllocator {
+public:
+    static const size_t kSlabSize = 256 * 1024;
+
+    // when less than this remains in a slab we start a new one
+    // avoids handing libuv tiny buffers and splitting reads
+    static const size_t kMinChunk = 16 * 1024;
+
+    // recycled slabs kept around, the rest goes back to the allocator
+    static const size_t kMaxFree = 4;
+
+    SlabAllocator() : _slab(0), _offset(0), _refs(1), _closed(false) {}
+
+    // per loop slab allocator, created on first use
+    static SlabAllocator* ForLoop(uv_loop_t* loop) {
+        LoopData* data = LoopData::Get(loop);
+        if (!data->slab) {
+            data->slab = new SlabAllocator();
+        }
+
+        return data->slab;
+    }
+
+    // the loop is going away, we are deleted once every slab js can still
+    // see has been collected
+    void Close() {
+        assert(!_closed);
+        _closed = true;
+
+        Rotate(false);
+
+        for (size_t i = 0 ; i < _free.size() ; ++i) {
+            FreeBlock(_free[i]);
+        }
+        _free.clear();
+
+        Unref();
+    }
+
+    // reserve space for a read of at most suggested_size bytes
+    // the space is only consumed once Commit is called
+    void Allocate(size_t suggested_size, uv_buf_t* buf) {
+        if (!_slab || kSlabSize - _offset < kMinChunk) {
+            Rotate(true);
+        }
+
+        const size_t remaining = kSlabSize - _offset;
+
+        buf->base = _slab + _offset;
+        buf->len = suggested_size < remaining ? suggested_size : remaining;
+    }
+
+    // consume nread bytes of the last allocation and return a view over them
+    // must be called within a HandleScope
+    v8::Local<v8::Uint8Array> Commit(const uv_buf_t* buf, size_t nread) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+
+        assert(buf->base == _slab + _offset);
+        assert(nread <= buf->len);
+
+        v8::Local<v8::ArrayBuffer> slab;
+        if (_slab_handle.IsEmpty()) {
+            assert(uvjs::detail::allocator);
+            slab = uvjs::detail::allocator->Externalize(_slab, kSlabSize, Recycle);
+            uvjs::detail::allocator->Pin(slab);
+            _slab_handle.Reset(isolate, slab);
+
+            // the slab comes back through Recycle
+            ++_refs;
+        }
+        else {
+            slab = v8::Local<v8::ArrayBuffer>::New(isolate, _slab_handle);
+        }
+
+        v8::Local<v8::Uint8Array> view = v8::Uint8Array::New(slab, _offset, nread);
+        _offset += nread;
+
+        return view;
+    }
+
+private:
+    // every slab is preceded by a header pointing back at its allocator
+    // Recycle only gets the slab pointer
+    struct Header {
+        SlabAllocator* owner;
+    };
+
+    static const size_t kHeaderSize = 16;
+    static const size_t kBlockSize = kHeaderSize + kSlabSize;
+
+    ~SlabAllocator() {
+        assert(_refs == 0);
+        assert(_free.empty());
+    }
+
+    static char* SlabOf(char* block) {
+        return block + kHeaderSize;
+    }
+
+    static char* BlockOf(char* slab) {
+        return slab - kHeaderSize;
+    }
+
+    static void FreeBlock(char* block) {
+        uvjs::detail::allocator->Free(block, kBlockSize);
+    }
+
+    // ArrayBufferAllocator::ReleaseCallback of slabs, the last view is gone
+    static void Recycle(void* data, size_t bytes) {
+        char* block = BlockOf(static_cast<char*>(data));
+        SlabAllocator* slab_allocator = reinterpret_cast<Header*>(block)->owner;
+
+        slab_allocator->Reuse(block);
+        slab_allocator->Unref();
+    }
+
+    void Reuse(char* block) {
+        if (_closed || _free.size() >= kMaxFree) {
+            FreeBlock(block);
+            return;
+        }
+
+        _free.push_back(block);
+    }
+
+    void Unref() {
+        assert(_refs > 0);
+        if (--_refs == 0) {
+            delete this;
+        }
+    }
+
+    // drop the current slab and optionally start a new one
+    void Rotate(bool replace) {
+        if (_slab) {
+            // nothing was ever committed, nobody can see this memory
+            if (_slab_handle.IsEmpty()) {
+                Reuse(BlockOf(_slab));
+            }
+            // outstanding views keep the slab alive, it comes back through Recycle
+            else {
+                _slab_handle.Reset();
+            }
+        }
+
+        _slab = 0;
+        _offset = 0;
+
+        if (!replace) {
+            return;
+        }
+
+        char* block = 0;
+        if (!_free.empty()) {
+            block = _free.back();
+            _free.pop_back();
+        }
+        else {
+            assert(uvjs::detail::allocator);
+            block = static_cast<char*>(uvjs::detail::allocator->AllocateUninitialized(kBlockSize));
+            assert(block);
+        }
+
+        reinterpret_cast<Header*>(block)->owner = this;
+        _slab = SlabOf(block);
+    }
+
+    char* _slab;
+    size_t _offset;
+    v8::Persistent<v8::ArrayBuffer> _slab_handle;
+
+    // full slabs waiting to be reused, never seen by js
+    std::vector<char*> _free;
+
+    // one for the loop and one for every slab js can see
+    size_t _refs;
+    bool _closed;
+};
+
+} // namespace detail
+} // namespace uvjs
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <assert.h>
+#include <uv.h>
+
+namespace uvjs {
+namespace detail {
+
+// process wide state shared by the loops of every thread
+//
+// uvjs has no init call which runs before the first loop thread, so the
+// mutexes and thread local keys below are created on first use with uv_once.
+// Tag picks the instance, every class which needs its own lock or key passes
+// itself.
+
+// StaticMutex is a process wide lock, a registry inherits it for Lock/Unlock
+template <typename Tag>
+class StaticMutex {
+public:
+    static void Lock() {
+        uv_once(&_once, Init);
+        uv_mutex_lock(&_lock);
+    }
+
+    static void Unlock() {
+        uv_mutex_unlock(&_lock);
+    }
+
+private:
+    static void Init() {
+        const int err = uv_mutex_init(&_lock);
+        assert(err == 0);
+        (void) err;
+    }
+
+    static uv_once_t _once;
+    static uv_mutex_t _lock;
+};
+
+template <typename Tag>
+uv_once_t StaticMutex<Tag>::_once = UV_ONCE_INIT;
+
+template <typename Tag>
+uv_mutex_t StaticMutex<Tag>::_lock;
+
+// ThreadLocal holds one T* per thread, NULL until set on that thread
+template <typename T, typename Tag = T>
+class ThreadLocal {
+public:
+    static T* Get() {
+        uv_once(&_once, CreateKey);
+        return static_cast<T*>(uv_key_get(&_key));
+    }
+
+    static void Set(T* value) {
+        uv_once(&_once, CreateKey);
+        uv_key_set(&_key, value);
+    }
+
+private:
+    static void CreateKey() {
+        const int err = uv_key_create(&_key);
+        assert(err == 0);
+        (void) err;
+    }
+
+    static uv_once_t _once;
+    static uv_key_t _key;
+};
+
+template <typename T, typename Tag>
+uv_once_t ThreadLocal<T, Tag>::_once = UV_ONCE_INIT;
+
+template <typename T, typename Tag>
+uv_key_t ThreadLocal<T, Tag>::_key;
+
+} // namespace detail
+} // namespace uvjs
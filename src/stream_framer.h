@@ -0,0 +1,249 @@
+#pragma once
+
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <v8.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "internal.h"
+
+namespace uvjs {
+namespace detail {
+
+// Framer splits the bytes read from a stream into frames before js sees them
+//
+// supported framings
+//  delimiter: frames end with a single delimiter byte (not included in the frame)
+//  length prefix: 1, 2 or 4 byte big or little endian length, then the frame
+//  fixed size: every frame is the same number of bytes
+//
+// frames which lie entirely within one read are views into the read buffer.
+// a frame spanning reads is assembled into its own buffer.
+//
+// a frame too large stops reading, the stream can't be framed past it. data
+// left over at eof is reported as an error carrying the bytes before eof.
+class Framer {
+public:
+    enum Mode {
+        kDelimiter,
+        kLengthPrefix,
+        kFixed
+    };
+
+    // frames (or unterminated data) larger than this are an error
+    static const size_t kMaxFrameSize = 64 * 1024 * 1024;
+
+    // build a framer from a js options object
+    // { delimiter: 10 } or { length_prefix: 4, little_endian: false } or { frame_size: 128 }
+    // returns NULL if the options describe no framing
+    static Framer* New(v8::Local<v8::Object> options) {
+        v8::Local<v8::Value> delimiter = options->Get(v8::String::NewSymbol("delimiter"));
+        v8::Local<v8::Value> length_prefix = options->Get(v8::String::NewSymbol("length_prefix"));
+        v8::Local<v8::Value> frame_size = options->Get(v8::String::NewSymbol("frame_size"));
+
+        if (delimiter->IsUint32()) {
+            assert(delimiter->Uint32Value() < 256);
+            return new Framer(kDelimiter, delimiter->Uint32Value());
+        }
+
+        if (length_prefix->IsUint32()) {
+            const uint32_t size = length_prefix->Uint32Value();
+            assert(size == 1 || size == 2 || size == 4);
+
+            Framer* framer = new Framer(kLengthPrefix, size);
+            framer->_little_endian = options->Get(
+                    v8::String::NewSymbol("little_endian"))->BooleanValue();
+            return framer;
+        }
+
+        if (frame_size->IsUint32()) {
+            assert(frame_size->Uint32Value() > 0);
+            return new Framer(kFixed, frame_size->Uint32Value());
+        }
+
+        return NULL;
+    }
+
+    // split len bytes at data into frames appended to frames
+    // data lies at offset within buffer, complete frames are views into buffer
+    // returns false if a frame is too large, the stream can't be framed anymore
+    bool Push(const char* data, size_t len,
+            v8::Local<v8::ArrayBuffer> buffer, size_t offset,
+            v8::Local<v8::Array> frames) {
+
+        size_t pos = 0;
+
+        // finish the frame left over from the previous read
+        if (!_partial.empty()) {
+            if (!Complete(data, len, &pos, frames)) {
+                return false;
+            }
+        }
+
+        while (pos < len) {
+            const char* start = data + pos;
+            const size_t remaining = len - pos;
+
+            if (_mode == kDelimiter) {
+                const char* end = static_cast<const char*>(memchr(start, _value, remaining));
+                if (!end) {
+                    break;
+                }
+
+                const size_t frame_len = end - start;
+                frames->Set(frames->Length(), v8::Uint8Array::New(buffer, offset + pos, frame_len));
+                pos += frame_len + 1;
+                continue;
+            }
+
+            const size_t total = FrameTotal(start, remaining);
+            if (!total || total > remaining) {
+                break;
+            }
+
+            const size_t header = HeaderSize();
+            frames->Set(frames->Length(),
+                    v8::Uint8Array::New(buffer, offset + pos + header, total - header));
+            pos += total;
+        }
+
+        // incomplete frame, keep it for the next read
+        _partial.insert(_partial.end(), data + pos, data + len);
+
+        if (_partial.size() > kMaxFrameSize) {
+            return false;
+        }
+
+        if (!_partial.empty() && _mode == kLengthPrefix &&
+                FrameTotal(&_partial[0], _partial.size()) > kMaxFrameSize) {
+            return false;
+        }
+
+        return true;
+    }
+
+    // bytes of an incomplete frame waiting for more data
+    size_t Pending() const {
+        return _partial.size();
+    }
+
+    // hand out the incomplete frame as is (header included), for reporting at eof
+    v8::Local<v8::Uint8Array> TakePending() {
+        const size_t len = _partial.size();
+        if (len == 0) {
+            return v8::Uint8Array::New(v8::ArrayBuffer::New(0), 0, 0);
+        }
+
+        assert(uvjs::detail::allocator);
+        char* copy = static_cast<char*>(uvjs::detail::allocator->AllocateUninitialized(len));
+        memcpy(copy, &_partial[0], len);
+        _partial.clear();
+
+        v8::Local<v8::ArrayBuffer> ab = uvjs::detail::allocator->Externalize(copy, len);
+        return v8::Uint8Array::New(ab, 0, len);
+    }
+
+private:
+    Framer(Mode mode, uint32_t value) : _mode(mode), _value(value), _little_endian(false) {}
+
+    // bytes preceding the frame contents
+    size_t HeaderSize() const {
+        return _mode == kLengthPrefix ? _value : 0;
+    }
+
+    // size of the frame starting at data including its header
+    // 0 if the header is not yet complete
+    size_t FrameTotal(const char* data, size_t len) const {
+        if (_mode == kFixed) {
+            return _value;
+        }
+
+        assert(_mode == kLengthPrefix);
+        if (len < _value) {
+            return 0;
+        }
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+        size_t size = 0;
+        for (uint32_t i = 0 ; i < _value ; ++i) {
+            const uint32_t idx = _little_endian ? _value - 1 - i : i;
+            size = (size << 8) | bytes[idx];
+        }
+
+        return _value + size;
+    }
+
+    // append bytes from data to the partial frame until it is complete
+    // a completed frame is copied into its own buffer
+    bool Complete(const char* data, size_t len, size_t* pos, v8::Local<v8::Array> frames) {
+        size_t frame_len = 0;
+        size_t header = HeaderSize();
+
+        if (_mode == kDelimiter) {
+            const char* end = static_cast<const char*>(memchr(data, _value, len));
+            if (!end) {
+                *pos = 0;
+                return true; // whole read is appended by the caller
+            }
+
+            _partial.insert(_partial.end(), data, end);
+            *pos = end - data + 1;
+            frame_len = _partial.size();
+        }
+        else {
+            for (;;) {
+                const size_t total = FrameTotal(&_partial[0], _partial.size());
+                if (total > kMaxFrameSize) {
+                    return false;
+                }
+
+                const size_t want = total ? total : header;
+                if (total && _partial.size() == total) {
+                    break;
+                }
+
+                if (*pos == len) {
+                    return true; // still incomplete, nothing left for the caller
+                }
+
+                const size_t take = std::min(want - _partial.size(), len - *pos);
+                _partial.insert(_partial.end(), data + *pos, data + *pos + take);
+                *pos += take;
+            }
+
+            frame_len = _partial.size() - header;
+        }
+
+        // empty frame, nothing to copy
+        if (frame_len == 0) {
+            _partial.clear();
+            frames->Set(frames->Length(), v8::Uint8Array::New(v8::ArrayBuffer::New(0), 0, 0));
+            return true;
+        }
+
+        assert(uvjs::detail::allocator);
+        char* copy = static_cast<char*>(uvjs::detail::allocator->AllocateUninitialized(frame_len));
+        memcpy(copy, &_partial[0] + header, frame_len);
+        _partial.clear();
+
+        v8::Local<v8::ArrayBuffer> ab = uvjs::detail::allocator->Externalize(copy, frame_len);
+        frames->Set(frames->Length(), v8::Uint8Array::New(ab, 0, frame_len));
+        return true;
+    }
+
+    Mode _mode;
+
+    // delimiter byte, prefix size or frame size depending on mode
+    uint32_t _value;
+    bool _little_endian;
+
+    // bytes of an incomplete frame
+    std::vector<char> _partial;
+};
+
+} // namespace detail
+} // namespace uvjs
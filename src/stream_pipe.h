@@ -0,0 +1,290 @@
+#pragma once
+
+#include <assert.h>
+#include <v8.h>
+#include <uv.h>
+
+#include "stream_wrap.h"
+#include "callback.h"
+#include "internal.h"
+#include "unwrap.h"
+
+namespace uvjs {
+namespace detail {
+
+// StreamPipe forwards everything read from one stream to another
+// without ever calling into js until the source ends or an error occurs
+//
+// each read gets its own buffer which is handed straight to the destination
+// write, a synchronous write is tried first and only the remainder is queued.
+// when the destination queues more than the high watermark the source stops
+// reading until the destination drains below the low watermark.
+//
+// closing either stream finishes the pipe with UV_ECANCELED once the writes
+// already queued on the destination are done. The closed end is let go of
+// right away, its wrap may be collected before those writes complete.
+class StreamPipe {
+public:
+    static const size_t kHighWatermark = 256 * 1024;
+    static const size_t kLowWatermark = 64 * 1024;
+
+    StreamPipe(StreamWrap<uv_stream_t>* src, StreamWrap<uv_stream_t>* dst)
+        : _src(src), _dst(dst), _pending(0), _status(0), _paused(false), _finishing(false) {
+
+        // both ends live for as long as we forward
+        _src->Ref();
+        _dst->Ref();
+        _src->set_pipe(this);
+        _dst->set_inbound_pipe(this);
+    }
+
+    ~StreamPipe() {
+        release_src();
+        release_dst();
+    }
+
+    Callback& done_callback() {
+        return _done_cb;
+    }
+
+    int start() {
+        // reads are ours now, drop the reference held for js reads
+        _src->read_stop();
+        return uv_read_start(_src->stream(), Alloc_Cb, Read_Cb);
+    }
+
+    // src or dst was closed, nothing more will be read or written
+    // may delete the pipe
+    void closed(StreamWrap<uv_stream_t>* wrap) {
+        if (wrap == _src) {
+            release_src();
+        }
+        else {
+            assert(wrap == _dst);
+            release_dst();
+        }
+
+        finish(UV_ECANCELED);
+    }
+
+private:
+    // queued write of a single read
+    struct PipeWrite {
+        uv_write_t req;
+        uv_buf_t buf;
+        StreamPipe* pipe;
+    };
+
+    // drop the references taken in the constructor, once per end
+    void release_src() {
+        if (_src) {
+            _src->set_pipe(0);
+            _src->Unref();
+            _src = 0;
+        }
+    }
+
+    void release_dst() {
+        if (_dst) {
+            _dst->set_inbound_pipe(0);
+            _dst->Unref();
+            _dst = 0;
+        }
+    }
+
+    // the source is done (eof or error), wait for queued writes then report
+    void finish(int status) {
+        if (_src && !uv_is_closing(_src->uv_handle())) {
+            uv_read_stop(_src->stream());
+        }
+
+        if (!_status) {
+            _status = status;
+        }
+
+        _finishing = true;
+        if (_pending == 0) {
+            done();
+        }
+    }
+
+    void done() {
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+
+        if (!_done_cb.IsEmpty()) {
+            const int argc = 1;
+            v8::Local<v8::Value> argv[argc] = { v8::Integer::New(_status) };
+            _done_cb.Call(argc, argv);
+        }
+
+        delete this;
+    }
+
+    // forward nread bytes of buf, buf is freed once they are written
+    void forward(const uv_buf_t* buf, size_t nread) {
+        uv_buf_t data = uv_buf_init(buf->base, nread);
+
+        const int written = uv_try_write(_dst->stream(), &data, 1);
+        if (written < 0 && written != UV_EAGAIN) {
+            uvjs::detail::allocator->Free(buf->base, buf->len);
+            return finish(written);
+        }
+
+        if (written > 0) {
+            _dst->count_written(written);
+        }
+
+        if (written == static_cast<int>(nread)) {
+            uvjs::detail::allocator->Free(buf->base, buf->len);
+            return;
+        }
+
+        const size_t offset = written > 0 ? written : 0;
+
+        PipeWrite* write = new PipeWrite;
+        write->buf = *buf;
+        write->pipe = this;
+        write->req.data = write;
+
+        uv_buf_t rest = uv_buf_init(buf->base + offset, nread - offset);
+        const int err = uv_write(&write->req, _dst->stream(), &rest, 1, After_Write);
+        if (err) {
+            uvjs::detail::allocator->Free(buf->base, buf->len);
+            delete write;
+            return finish(err);
+        }
+
+        _dst->count_written(rest.len);
+        ++_pending;
+
+        // slow consumer, stop reading until it catches up
+        if (!_paused && _dst->stream()->write_queue_size > kHighWatermark) {
+            _paused = true;
+            uv_read_stop(_src->stream());
+        }
+    }
+
+    static void Alloc_Cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+        buf->base = static_cast<char*>(uvjs::detail::allocator->
+                AllocateUninitialized(suggested_size));
+        buf->len = suggested_size;
+
+        assert(buf->base);
+    }
+
+    static void Read_Cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+        StreamWrap<uv_stream_t>* wrap = static_cast<StreamWrap<uv_stream_t> *>(stream->data);
+        StreamPipe* pipe = wrap->pipe();
+        assert(pipe);
+
+        if (nread <= 0) {
+            if (buf->base) {
+                uvjs::detail::allocator->Free(buf->base, buf->len);
+            }
+
+            // nothing read (EAGAIN)
+            if (nread == 0) {
+                return;
+            }
+
+            return pipe->finish(nread == UV_EOF ? 0 : nread);
+        }
+
+        wrap->touch();
+        wrap->count_read(nread);
+
+        // hand the read buffer to the destination, it is freed once written
+        pipe->forward(buf, nread);
+    }
+
+    static void After_Write(uv_write_t* req, int status) {
+        PipeWrite* write = static_cast<PipeWrite*>(req->data);
+        StreamPipe* pipe = write->pipe;
+
+        uvjs::detail::allocator->Free(write->buf.base, write->buf.len);
+        delete write;
+
+        --pipe->_pending;
+
+        if (status < 0) {
+            return pipe->finish(status);
+        }
+
+        if (pipe->_finishing) {
+            if (pipe->_pending == 0) {
+                pipe->done();
+            }
+            return;
+        }
+
+        pipe->_dst->touch();
+
+        // caught up, resume reading
+        if (pipe->_paused && pipe->_dst->stream()->write_queue_size <= kLowWatermark) {
+            pipe->_paused = false;
+
+            const int err = uv_read_start(pipe->_src->stream(), Alloc_Cb, Read_Cb);
+            if (err) {
+                pipe->finish(err);
+            }
+        }
+    }
+
+    StreamWrap<uv_stream_t>* _src;
+    StreamWrap<uv_stream_t>* _dst;
+
+    Callback _done_cb;
+
+    size_t _pending;
+    int _status;
+    bool _paused;
+    bool _finishing;
+};
+
+// pipe(dst, cb)
+//
+// forward all data read from this stream to dst natively
+// cb(status) is called once this stream ends (status 0), either side fails or
+// either side is closed (UV_ECANCELED)
+// reading is taken over by the pipe, read_start fails with UV_EBUSY while piping
+template <typename T>
+void StreamWrap<T>::Stream_Pipe(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[0]->IsObject());
+    assert(args[1]->IsFunction());
+
+    StreamWrap<uv_stream_t>* src = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+    StreamWrap<uv_stream_t>* dst = Unwrap<StreamWrap<uv_stream_t> >(args[0]);
+
+    assert(!src->pipe());
+    assert(!dst->inbound_pipe());
+
+    StreamPipe* pipe = new StreamPipe(src, dst);
+    pipe->done_callback().Reset(args[1]);
+
+    const int err = pipe->start();
+    if (err) {
+        delete pipe;
+    }
+
+    args.GetReturnValue().Set(v8::Integer::New(err));
+}
+
+template <typename T>
+void StreamWrap<T>::close_pipes() {
+    StreamWrap<uv_stream_t>* wrap = static_cast<StreamWrap<uv_stream_t> *>(this->_handle->data);
+
+    if (_pipe) {
+        _pipe->closed(wrap);
+    }
+
+    // finishing the pipe above may have finished this one too
+    if (_inbound_pipe) {
+        _inbound_pipe->closed(wrap);
+    }
+}
+
+} // namespace detail
+} // namespace uvjs
@@ -1,20 +1,45 @@
 #pragma once
 
 #include <assert.h>
+#include <stdint.h>
 #include <v8.h>
 #include <uv.h>
 
+#include <vector>
+#include <algorithm>
+
 #include "handle_wrap.h"
 #include "callback.h"
+#include "buffer.h"
+#include "slab_allocator.h"
+#include "loop_data.h"
+#include "stream_framer.h"
 #include "internal.h"
 
 namespace uvjs {
 namespace detail {
 
+// returned by write when all data was written synchronously
+static const int kWriteDone = 1;
+
+class WriteReq;
+class StreamPipe;
+
 template <typename T>
 class StreamWrap : public HandleWrap<T> {
 public:
-    StreamWrap() : HandleWrap<T>() {}
+    StreamWrap() : HandleWrap<T>(), _reading(false),
+        _read_base(0), _read_len(0), _read_offset(0),
+        _corked(false), _corked_req(0), _corked_bytes(0),
+        _high_watermark(0), _low_watermark(0), _over_high_watermark(false),
+        _pipe(0), _inbound_pipe(0), _framer(0),
+        _timeout(0), _timeout_ms(0), _last_activity(0), _timed_out(false),
+        _bytes_read(0), _bytes_submitted(0), _writes_pending(0) {}
+
+    ~StreamWrap() {
+        _read_buffer.Reset();
+        delete _framer;
+    }
 
     int listen(int backlog) {
         assert(this->_handle);
@@ -30,22 +55,281 @@ public:
         return _read_cb;
     }
 
+    // a reading stream stays alive for its read callback
     int read_start() {
-        this->Ref();
-        return uv_read_start(this->_handle, Alloc_Cb, Read_Cb);
+        const int err = uv_read_start(this->_handle, Alloc_Cb, Read_Cb);
+        if (!err && !_reading) {
+            _reading = true;
+            this->Ref();
+        }
+        return err;
+    }
+
+    int read_stop() {
+        const int err = uv_read_stop(this->_handle);
+        if (_reading) {
+            _reading = false;
+            this->Unref();
+        }
+        return err;
+    }
+
+    // read into a caller supplied buffer instead of the loop slab
+    // the buffer is used as a ring, reads wrap to the start once the tail is full
+    // passing an empty handle goes back to slab reads
+    void read_into(v8::Local<v8::Value> buffer) {
+        if (!_read_buffer.IsEmpty()) {
+            v8::Isolate* isolate = v8::Isolate::GetCurrent();
+            v8::HandleScope scope(isolate);
+
+            v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::New(isolate, _read_buffer);
+            uvjs::detail::allocator->Unpin(ab);
+        }
+
+        _read_buffer.Reset();
+        _read_base = 0;
+        _read_len = 0;
+        _read_offset = 0;
+
+        if (buffer.IsEmpty()) {
+            return;
+        }
+
+        uv_buf_t buf;
+        v8::Local<v8::ArrayBuffer> ab = BufferContents(buffer, &buf);
+        assert(buf.len > 0);
+
+        // keep the memory alive and pinned for as long as we read into it
+        _read_buffer.Reset(v8::Isolate::GetCurrent(), ab);
+        uvjs::detail::allocator->Pin(ab);
+        _read_base = buf.base;
+        _read_len = buf.len;
     }
 
+    // the WriteReq holds the reference which keeps us alive for Write_Cb
     int write(uv_write_t* req, uv_buf_t bufs[], const int num_bufs) {
-        this->Ref();
-        return uv_write(req, this->_handle, bufs, num_bufs, Write_Cb);
+        const int err = uv_write(req, this->_handle, bufs, num_bufs, Write_Cb);
+        if (!err) {
+            ++_writes_pending;
+            for (int i = 0 ; i < num_bufs ; ++i) {
+                _bytes_submitted += bufs[i].len;
+            }
+        }
+        return err;
+    }
+
+    // write as much as possible without blocking
+    // returns the number of bytes written or UV_EAGAIN if nothing could be written
+    int try_write(uv_buf_t bufs[], const int num_bufs) {
+        const int written = uv_try_write(this->_handle, bufs, num_bufs);
+        if (written > 0) {
+            _bytes_submitted += written;
+        }
+        return written;
+    }
+
+    // byte counts for walk(), for writes made outside of write/try_write
+    inline void count_read(size_t bytes) {
+        _bytes_read += bytes;
+    }
+
+    inline void count_written(size_t bytes) {
+        _bytes_submitted += bytes;
+    }
+
+    // written is what was handed to the stream minus what is still queued
+    void Describe(v8::Local<v8::Object> info) {
+        HandleWrap<T>::Describe(info);
+
+        const double written = static_cast<double>(_bytes_submitted - this->_handle->write_queue_size);
+
+        info->Set(v8::String::NewSymbol("bytes_read"), v8::Number::New(static_cast<double>(_bytes_read)));
+        info->Set(v8::String::NewSymbol("bytes_written"), v8::Number::New(written));
+        info->Set(v8::String::NewSymbol("write_queue_size"), v8::Number::New(static_cast<double>(write_queue_size())));
+        info->Set(v8::String::NewSymbol("writes_pending"), v8::Integer::NewFromUnsigned(_writes_pending));
+        info->Set(v8::String::NewSymbol("reading"), v8::Boolean::New(_reading));
+        info->Set(v8::String::NewSymbol("read_cb"), v8::Boolean::New(!_read_cb.IsEmpty()));
+        info->Set(v8::String::NewSymbol("listen_cb"), v8::Boolean::New(!_listen_cb.IsEmpty()));
+    }
+
+    // while corked, writes are collected and sent as a single writev
+    // at the end of the loop iteration (or on uncork)
+    void cork() {
+        _corked = true;
+    }
+
+    void uncork() {
+        _corked = false;
+        flush();
+    }
+
+    bool corked() const {
+        return _corked;
+    }
+
+    // split reads into frames before calling js, NULL for raw reads
+    void set_framer(Framer* framer) {
+        delete _framer;
+        _framer = framer;
+    }
+
+    inline uv_stream_t* stream() {
+        return reinterpret_cast<uv_stream_t*>(this->_handle);
+    }
+
+    // set while our reads are forwarded natively, see StreamPipe
+    StreamPipe* pipe() const {
+        return _pipe;
+    }
+
+    void set_pipe(StreamPipe* pipe) {
+        _pipe = pipe;
+    }
+
+    // set while a pipe forwards into this stream
+    StreamPipe* inbound_pipe() const {
+        return _inbound_pipe;
+    }
+
+    void set_inbound_pipe(StreamPipe* pipe) {
+        _inbound_pipe = pipe;
+    }
+
+    // bytes waiting to be written, including corked writes
+    size_t write_queue_size() const {
+        return this->_handle->write_queue_size + _corked_bytes;
+    }
+
+    Callback& drain_callback() {
+        return _drain_cb;
+    }
+
+    // drain fires once the write queue falls to low after having exceeded high
+    // a high watermark of 0 disables the drain callback
+    void set_watermarks(size_t high, size_t low) {
+        assert(low <= high);
+        _high_watermark = high;
+        _low_watermark = low;
+        _over_high_watermark = false;
+    }
+
+    // called after queuing writes
+    void check_high_watermark() {
+        if (_high_watermark && write_queue_size() > _high_watermark) {
+            _over_high_watermark = true;
+        }
+    }
+
+    // called after writes complete
+    void check_low_watermark() {
+        if (!_over_high_watermark || write_queue_size() > _low_watermark) {
+            return;
+        }
+
+        _over_high_watermark = false;
+
+        if (!_drain_cb.IsEmpty()) {
+            _drain_cb.Call();
+        }
+    }
+
+    // collect a corked write, data is a buffer or array of buffers
+    void cork_write(v8::Local<v8::Value> data, v8::Local<v8::Value> cb);
+
+    // send everything collected while corked
+    void flush();
+
+    Callback& timeout_callback() {
+        return _timeout_cb;
+    }
+
+    // call the timeout callback once the stream saw no reads or completed
+    // writes for ms milliseconds, 0 disables the timeout
+    //
+    // traffic only records a timestamp, the timer is re-armed lazily when it
+    // fires early. It does not keep the loop alive on its own.
+    int set_timeout(uint64_t ms) {
+        _timeout_ms = ms;
+        _timed_out = false;
+
+        if (!ms) {
+            return _timeout ? uv_timer_stop(_timeout) : 0;
+        }
+
+        if (!_timeout) {
+            _timeout = new uv_timer_t;
+
+            const int err = uv_timer_init(this->_handle->loop, _timeout);
+            if (err) {
+                delete _timeout;
+                _timeout = 0;
+                return err;
+            }
+
+            _timeout->data = this;
+            uv_unref(reinterpret_cast<uv_handle_t*>(_timeout));
+        }
+
+        _last_activity = uv_now(this->_handle->loop);
+        return uv_timer_start(_timeout, After_Timeout, ms, 0);
+    }
+
+    // traffic on the stream, pushes the inactivity deadline back
+    inline void touch() {
+        if (!_timeout_ms) {
+            return;
+        }
+
+        _last_activity = uv_now(this->_handle->loop);
+
+        // the timeout fired already, start watching for the next one
+        if (_timed_out) {
+            _timed_out = false;
+            uv_timer_start(_timeout, After_Timeout, _timeout_ms, 0);
+        }
     }
 
+    // the timeout timer goes away with the stream, pipes on either end finish
+    void Closed() {
+        // libuv stopped reading, drop the reference taken by read_start while
+        // the close reference still holds us
+        if (_reading) {
+            _reading = false;
+            this->Unref();
+        }
+
+        // nothing is read into the ring anymore
+        read_into(v8::Local<v8::Value>());
+
+        if (_timeout) {
+            uv_close(reinterpret_cast<uv_handle_t*>(_timeout), After_Timeout_Close);
+            _timeout = 0;
+        }
+
+        close_pipes();
+    }
+
+    // defined with StreamPipe
+    void close_pipes();
+
     static void Alloc_Cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
-        // create an array buffer on the newly allocated data
-        buf->base = static_cast<char*>(uvjs::detail::allocator->
-                AllocateUninitialized(suggested_size));
-        buf->len = suggested_size;
+        StreamWrap<uv_stream_t>* wrap = static_cast<StreamWrap<uv_stream_t> *>(handle->data);
 
+        // caller supplied ring, read into the tail and wrap once it is full
+        if (wrap->_read_base) {
+            if (wrap->_read_offset == wrap->_read_len) {
+                wrap->_read_offset = 0;
+            }
+
+            const size_t remaining = wrap->_read_len - wrap->_read_offset;
+
+            buf->base = wrap->_read_base + wrap->_read_offset;
+            buf->len = suggested_size < remaining ? suggested_size : remaining;
+            return;
+        }
+
+        // reads are carved out of the loop's shared slab
+        SlabAllocator::ForLoop(handle->loop)->Allocate(suggested_size, buf);
         assert(buf->base);
     }
 
@@ -53,12 +337,23 @@ public:
         v8::Isolate* isolate = v8::Isolate::GetCurrent();
         v8::HandleScope handle_scope(isolate);
 
-        assert(buf->base);
         StreamWrap<uv_stream_t>* wrap = static_cast<StreamWrap<uv_stream_t> *>(stream->data);
 
-        // eof, buffer should be freed, will not be used
-        if (nread == UV_EOF) {
-            uvjs::detail::allocator->Free(buf->base, buf->len);
+        // nothing read (EAGAIN), slab space was not consumed
+        if (nread == 0) {
+            return;
+        }
+        // eof, slab space was not consumed
+        else if (nread == UV_EOF) {
+            // the stream ended within a frame
+            if (wrap->_framer && wrap->_framer->Pending()) {
+                v8::Local<v8::Value> err = v8::Exception::Error(v8::String::New("partial frame at eof"));
+                err->ToObject()->Set(v8::String::NewSymbol("data"), wrap->_framer->TakePending());
+
+                const int argc = 2;
+                v8::Local<v8::Value> argv[argc] = { err , v8::Undefined() };
+                wrap->read_callback().Call(argc, argv);
+            }
 
             // callback with null for data to indicate to user EOF
             const int argc = 2;
@@ -67,10 +362,8 @@ public:
 
             return;
         }
-        // read error, buffer should be freed, will not be used
+        // read error, slab space was not consumed
         else if (nread < 0) {
-            uvjs::detail::allocator->Free(buf->base, buf->len);
-
             v8::Local<v8::Value> err = v8::Exception::Error(v8::String::New("read error"));
 
             const int argc = 2;
@@ -79,17 +372,91 @@ public:
             return;
         }
 
-        assert(uvjs::detail::allocator);
-        v8::Local<v8::ArrayBuffer> arr = uvjs::detail::allocator->Externalize(buf->base, nread);
+        assert(buf->base);
+
+        wrap->touch();
+        wrap->_bytes_read += nread;
+
+        // caller supplied buffer, report where the data landed
+        if (wrap->_read_base) {
+            assert(buf->base == wrap->_read_base + wrap->_read_offset);
+
+            const size_t offset = wrap->_read_offset;
+            wrap->_read_offset += nread;
+
+            const int argc = 3;
+            v8::Local<v8::Value> argv[argc] = {
+                v8::Undefined(),
+                v8::Integer::NewFromUnsigned(offset),
+                v8::Integer::New(nread)
+            };
+            wrap->read_callback().Call(argc, argv);
+            return;
+        }
+
+        v8::Local<v8::Uint8Array> data = SlabAllocator::ForLoop(stream->loop)->Commit(buf, nread);
+
+        // one callback per batch of complete frames
+        if (wrap->_framer) {
+            v8::Local<v8::Array> frames = v8::Array::New();
+
+            const bool ok = wrap->_framer->Push(buf->base, nread,
+                    data->Buffer(), data->ByteOffset(), frames);
+
+            // nothing past this point can be framed, further reads would
+            // have to switch to raw data. stop instead, read_start resumes
+            if (!ok) {
+                wrap->read_stop();
+
+                v8::Local<v8::Value> err = v8::Exception::Error(v8::String::New("frame too large"));
+
+                const int argc = 2;
+                v8::Local<v8::Value> argv[argc] = { err , v8::Undefined() };
+                wrap->read_callback().Call(argc, argv);
+                return;
+            }
+
+            if (frames->Length() == 0) {
+                return;
+            }
+
+            const int argc = 2;
+            v8::Local<v8::Value> argv[argc] = { v8::Undefined() , frames };
+            wrap->read_callback().Call(argc, argv);
+            return;
+        }
 
         const int argc = 2;
-        v8::Local<v8::Value> argv[argc] = { v8::Undefined() , arr };
+        v8::Local<v8::Value> argv[argc] = { v8::Undefined() , data };
         wrap->read_callback().Call(argc, argv);
     }
 
     static void Write_Cb(uv_write_t* req, int status);
     static void After_Listen(uv_stream_t* server, int status);
 
+    static void After_Timeout(uv_timer_t* handle, int status) {
+        MetricsPhase phase(LoopMetrics::kPhaseTimer);
+        StreamWrap<uv_stream_t>* wrap = static_cast<StreamWrap<uv_stream_t> *>(handle->data);
+
+        // there was traffic since the timer was started, wait for the rest
+        const uint64_t idle = uv_now(handle->loop) - wrap->_last_activity;
+        if (idle < wrap->_timeout_ms) {
+            uv_timer_start(handle, After_Timeout, wrap->_timeout_ms - idle, 0);
+            return;
+        }
+
+        wrap->_timed_out = true;
+
+        v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+        if (!wrap->timeout_callback().IsEmpty()) {
+            wrap->timeout_callback().Call();
+        }
+    }
+
+    static void After_Timeout_Close(uv_handle_t* handle) {
+        delete reinterpret_cast<uv_timer_t*>(handle);
+    }
+
     static void Stream_Listen(const v8::FunctionCallbackInfo<v8::Value>& args) {
         v8::HandleScope handle_scope(args.GetIsolate());
 
@@ -104,119 +471,467 @@ public:
         args.GetReturnValue().Set(v8::Integer::New(err));
     }
 
+    // read_start(cb) -> cb(err, data)
+    // read_start(buffer, cb) -> cb(err, offset, nread)
+    // read_start(framing, cb) -> cb(err, [frame, ...])
+    //
+    // the second form reads into buffer (ArrayBuffer or view) without allocating
+    // data must be consumed before the ring wraps around and overwrites it
+    //
+    // the third form splits reads into frames natively, see Framer for options
     static void Stream_Read_Start(const v8::FunctionCallbackInfo<v8::Value>& args) {
         v8::HandleScope handle_scope(args.GetIsolate());
 
-        assert(args.Length() == 1);
-        assert(args[0]->IsFunction());
+        assert(args.Length() == 1 || args.Length() == 2);
+        assert(args[args.Length() - 1]->IsFunction());
 
         StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
 
-        wrap->read_callback().Reset(args[0]);
+        // reads belong to the pipe until it is done
+        if (wrap->pipe()) {
+            return args.GetReturnValue().Set(v8::Integer::New(UV_EBUSY));
+        }
+
+        wrap->read_into(v8::Local<v8::Value>());
+        wrap->set_framer(NULL);
+
+        if (args.Length() == 2 && IsBuffer(args[0])) {
+            wrap->read_into(args[0]);
+        }
+        else if (args.Length() == 2) {
+            assert(args[0]->IsObject());
+
+            Framer* framer = Framer::New(args[0]->ToObject());
+            assert(framer);
+            wrap->set_framer(framer);
+        }
+
+        wrap->read_callback().Reset(args[args.Length() - 1]);
         const int err = wrap->read_start();
 
         args.GetReturnValue().Set(v8::Integer::New(err));
     }
 
+    static void Stream_Read_Stop(const v8::FunctionCallbackInfo<v8::Value>& args) {
+        v8::HandleScope handle_scope(args.GetIsolate());
+
+        StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+
+        const int err = wrap->read_stop();
+        args.GetReturnValue().Set(v8::Integer::New(err));
+    }
+
     static void Stream_Write(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Stream_Pipe(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static void Stream_Write_Queue_Size(const v8::FunctionCallbackInfo<v8::Value>& args) {
+        v8::HandleScope handle_scope(args.GetIsolate());
+
+        StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+        args.GetReturnValue().Set(v8::Number::New(static_cast<double>(wrap->write_queue_size())));
+    }
+
+    // set_watermarks(high, low, drain_cb)
+    static void Stream_Set_Watermarks(const v8::FunctionCallbackInfo<v8::Value>& args) {
+        v8::HandleScope handle_scope(args.GetIsolate());
+
+        assert(args.Length() == 3);
+        assert(args[0]->IsUint32());
+        assert(args[1]->IsUint32());
+        assert(args[2]->IsFunction());
+
+        StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+
+        wrap->set_watermarks(args[0]->Uint32Value(), args[1]->Uint32Value());
+        wrap->drain_callback().Reset(args[2]);
+    }
+
+    static void Stream_Cork(const v8::FunctionCallbackInfo<v8::Value>& args) {
+        v8::HandleScope handle_scope(args.GetIsolate());
+
+        StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+        wrap->cork();
+    }
+
+    static void Stream_Uncork(const v8::FunctionCallbackInfo<v8::Value>& args) {
+        v8::HandleScope handle_scope(args.GetIsolate());
+
+        StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+        wrap->uncork();
+    }
+
+    // set_timeout(ms, cb)
+    static void Stream_Set_Timeout(const v8::FunctionCallbackInfo<v8::Value>& args) {
+        v8::HandleScope handle_scope(args.GetIsolate());
+
+        assert(args.Length() == 2);
+        assert(args[0]->IsUint32());
+        assert(args[1]->IsFunction());
+
+        StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
+        wrap->timeout_callback().Reset(args[1]);
+
+        const int err = wrap->set_timeout(args[0]->Uint32Value());
+        args.GetReturnValue().Set(v8::Integer::New(err));
+    }
 
     static void Mixin(v8::Handle<v8::ObjectTemplate> obj) {
         HandleWrap<T>::Mixin(obj);
 
         obj->Set(v8::String::NewSymbol("listen"), v8::FunctionTemplate::New(Stream_Listen));
         obj->Set(v8::String::NewSymbol("read_start"), v8::FunctionTemplate::New(Stream_Read_Start));
+        obj->Set(v8::String::NewSymbol("read_stop"), v8::FunctionTemplate::New(Stream_Read_Stop));
         obj->Set(v8::String::NewSymbol("write"), v8::FunctionTemplate::New(Stream_Write));
+        obj->Set(v8::String::NewSymbol("pipe"), v8::FunctionTemplate::New(Stream_Pipe));
+        obj->Set(v8::String::NewSymbol("write_queue_size"), v8::FunctionTemplate::New(Stream_Write_Queue_Size));
+        obj->Set(v8::String::NewSymbol("set_watermarks"), v8::FunctionTemplate::New(Stream_Set_Watermarks));
+        obj->Set(v8::String::NewSymbol("cork"), v8::FunctionTemplate::New(Stream_Cork));
+        obj->Set(v8::String::NewSymbol("uncork"), v8::FunctionTemplate::New(Stream_Uncork));
+        obj->Set(v8::String::NewSymbol("set_timeout"), v8::FunctionTemplate::New(Stream_Set_Timeout));
     }
 
 protected:
     Callback _listen_cb;
     Callback _read_cb;
+    Callback _drain_cb;
+
+    bool _reading;
+
+    // caller supplied read buffer, see read_into
+    v8::Persistent<v8::ArrayBuffer> _read_buffer;
+    char* _read_base;
+    size_t _read_len;
+    size_t _read_offset;
+
+    // writes collected while corked, see cork_write
+    bool _corked;
+    WriteReq* _corked_req;
+    std::vector<uv_buf_t> _corked_bufs;
+    size_t _corked_bytes;
+
+    // backpressure, see set_watermarks
+    size_t _high_watermark;
+    size_t _low_watermark;
+    bool _over_high_watermark;
+
+    StreamPipe* _pipe;
+    StreamPipe* _inbound_pipe;
+    Framer* _framer;
+
+    // inactivity timeout, see set_timeout
+    uv_timer_t* _timeout;
+    uint64_t _timeout_ms;
+    uint64_t _last_activity;
+    bool _timed_out;
+    Callback _timeout_cb;
+
+    // accounting reported by walk()
+    uint64_t _bytes_read;
+    uint64_t _bytes_submitted;
+    unsigned int _writes_pending;
 };
 
 class WriteReq {
 public:
-    WriteReq(StreamWrap<uv_stream_t>* wrap, v8::Local<v8::ArrayBuffer>& arr) {
+    // buffers is the ArrayBuffer (or array of ArrayBuffers) backing the write
+    // it is kept alive and pinned until the write completes
+    WriteReq(StreamWrap<uv_stream_t>* wrap, v8::Local<v8::Object> buffers) : _pinned(true) {
         _wrap = wrap;
-        _array_handle.Reset(v8::Isolate::GetCurrent(), arr);
+        _buffers_handle.Reset(v8::Isolate::GetCurrent(), buffers);
         _wrap->Ref();
+
+        PinBuffers(buffers, true);
     }
 
     ~WriteReq() {
+        unpin();
+
         _wrap->Unref();
-        _array_handle.Reset();
+        _buffers_handle.Reset();
+
+        for (size_t i = 0 ; i < _write_cbs.size() ; ++i) {
+            delete _write_cbs[i];
+        }
+    }
+
+    // keep another buffer alive, requires an array of buffers
+    void hold(v8::Local<v8::Object> buffer) {
+        v8::Local<v8::Object> buffers = v8::Local<v8::Object>::New(
+                v8::Isolate::GetCurrent(), _buffers_handle);
+        assert(buffers->IsArray());
+
+        v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(buffers);
+        arr->Set(arr->Length(), buffer);
+
+        PinBuffers(buffer, true);
     }
 
-    Callback& write_callback() {
-        return _write_cb;
+    // a corked write completes many js writes at once
+    void add_callback(v8::Local<v8::Value> fn) {
+        Callback* cb = new Callback();
+        cb->Reset(fn);
+        _write_cbs.push_back(cb);
+    }
+
+    // invoke every write callback with the write status
+    // the buffers are unpinned first, callbacks may transfer them
+    // should be called within a handle scope
+    void Done(int status) {
+        unpin();
+
+        for (size_t i = 0 ; i < _write_cbs.size() ; ++i) {
+            const int argc = 1;
+            v8::Local<v8::Value> argv[argc] = { v8::Integer::New(status) };
+            _write_cbs[i]->Call(argc, argv);
+        }
     }
 
 private:
-    Callback _write_cb;
-    v8::Persistent<v8::ArrayBuffer> _array_handle;
+    void unpin() {
+        if (!_pinned) {
+            return;
+        }
+
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        v8::HandleScope scope(isolate);
+
+        PinBuffers(v8::Local<v8::Object>::New(isolate, _buffers_handle), false);
+        _pinned = false;
+    }
+
+    std::vector<Callback*> _write_cbs;
+    v8::Persistent<v8::Object> _buffers_handle;
     StreamWrap<uv_stream_t>* _wrap;
+    bool _pinned;
 };
 
+// CorkFlusher sends the writes of corked streams once per loop iteration
+//
+// flushing happens from both a check and a prepare hook, so writes made in
+// io callbacks go out right after poll and writes made in timers go out before
+// the loop blocks in poll again. The hooks are unref'd and only run while
+// there are corked writes waiting.
+class CorkFlusher {
+public:
+    CorkFlusher(uv_loop_t* loop) {
+        uv_check_init(loop, &_check);
+        uv_prepare_init(loop, &_prepare);
+        _check.data = this;
+        _prepare.data = this;
+
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_check));
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_prepare));
+    }
+
+    static CorkFlusher* ForLoop(uv_loop_t* loop) {
+        LoopData* data = LoopData::Get(loop);
+        if (!data->cork_flusher) {
+            data->cork_flusher = new CorkFlusher(loop);
+        }
+
+        return data->cork_flusher;
+    }
+
+    // release the hooks, the loop must run once more before we are deleted
+    void Close() {
+        uv_close(reinterpret_cast<uv_handle_t*>(&_check), NULL);
+        uv_close(reinterpret_cast<uv_handle_t*>(&_prepare), NULL);
+    }
+
+    // flush wrap at the end of this loop iteration
+    void Schedule(StreamWrap<uv_stream_t>* wrap) {
+        if (_pending.empty()) {
+            uv_check_start(&_check, After_Check);
+            uv_prepare_start(&_prepare, After_Prepare);
+        }
+
+        _pending.push_back(wrap);
+    }
+
+    // wrap was flushed early
+    void Cancel(StreamWrap<uv_stream_t>* wrap) {
+        _pending.erase(std::remove(_pending.begin(), _pending.end(), wrap), _pending.end());
+        _flushing.erase(std::remove(_flushing.begin(), _flushing.end(), wrap), _flushing.end());
+    }
+
+private:
+    void Flush() {
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+
+        uv_check_stop(&_check);
+        uv_prepare_stop(&_prepare);
+
+        // write callbacks may cork and write again, those go out next time
+        // callbacks may also uncork (and release) streams we have yet to visit
+        _flushing.swap(_pending);
+
+        while (!_flushing.empty()) {
+            StreamWrap<uv_stream_t>* wrap = _flushing.front();
+            _flushing.erase(_flushing.begin());
+            wrap->flush();
+        }
+    }
+
+    static void After_Check(uv_check_t* handle, int status) {
+        static_cast<CorkFlusher*>(handle->data)->Flush();
+    }
+
+    static void After_Prepare(uv_prepare_t* handle, int status) {
+        static_cast<CorkFlusher*>(handle->data)->Flush();
+    }
+
+    uv_check_t _check;
+    uv_prepare_t _prepare;
+    std::vector<StreamWrap<uv_stream_t>*> _pending;
+    std::vector<StreamWrap<uv_stream_t>*> _flushing;
+};
+
+// write(buffer, cb)
+// write([buffer, ...], cb)
+//
+// an array of buffers is sent with a single writev and a single callback,
+// an empty array counts as written inline
+//
+// the write is first attempted synchronously, only what could not be written
+// is queued. returns kWriteDone if everything was written inline, in that
+// case cb is not called. returns 0 if the write was queued and cb will be called
 template <typename T>
 void StreamWrap<T>::Stream_Write(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
     assert(args.Length() == 2);
-    //assert(args[0]->IsArray());
-    assert(args[0]->IsArrayBuffer());
+    assert(args[0]->IsArray() || IsBuffer(args[0]));
     assert(args[1]->IsFunction());
 
     StreamWrap<uv_stream_t>* wrap = Unwrap<StreamWrap<uv_stream_t> >(args.This());
 
-    uv_write_t* req = new uv_write_t;
+    // collected and sent with the other writes of this loop iteration
+    if (wrap->corked()) {
+        wrap->cork_write(args[0], args[1]);
+        return args.GetReturnValue().Set(v8::Integer::New(0));
+    }
 
-    const unsigned int num_bufs = 1;
-    uv_buf_t bufs[num_bufs];
+    // views (such as read data) are written from their backing buffer
+    std::vector<uv_buf_t> bufs;
+    v8::Local<v8::Object> buffers = WriteBuffers(args[0], bufs);
 
-    v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(args[0]);
+    // an empty array, nothing to wait for
+    if (bufs.empty()) {
+        return args.GetReturnValue().Set(v8::Integer::New(kWriteDone));
+    }
+
+    // fast path, nothing allocated and no callback if the socket takes it all
+    // try_write refuses (EAGAIN) if earlier writes are still queued
+    const int written = wrap->try_write(&bufs[0], bufs.size());
+    if (written < 0 && written != UV_EAGAIN) {
+        return args.GetReturnValue().Set(v8::Integer::New(written));
+    }
+
+    if (written > 0) {
+        wrap->touch();
+    }
+
+    const size_t first = ConsumeBuffers(bufs, written > 0 ? written : 0);
+    if (first == bufs.size()) {
+        return args.GetReturnValue().Set(v8::Integer::New(kWriteDone));
+    }
 
-    assert(uvjs::detail::allocator);
-    bufs[0].base = static_cast<char*>(uvjs::detail::allocator->Externalized(ab));
-    bufs[0].len = ab->ByteLength();
+    uv_write_t* req = new uv_write_t;
 
-    WriteReq* write_req = new WriteReq(wrap, ab);
-    write_req->write_callback().Reset(args[1]);
+    WriteReq* write_req = new WriteReq(wrap, buffers);
+    write_req->add_callback(args[1]);
 
     // actually, req data needs to be a additional wrapper
     // which will hold the callback for this write
     req->data = write_req;
 
-    const int err = wrap->write(req, bufs, num_bufs);
+    // libuv copies the buf structs, only the memory needs to stay alive
+    const int err = wrap->write(req, &bufs[first], bufs.size() - first);
 
     if (err) {
         delete write_req;
         delete req;
     }
+    else {
+        wrap->check_high_watermark();
+    }
 
     args.GetReturnValue().Set(v8::Integer::New(err));
+}
 
-#if 0
-    // array of ArrayBuffers
-    // we can queue more than one write array at a time
-    // TODO handle faster case where user just passes a single array
-    // avoids additional casts
-    v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(args[0]);
+template <typename T>
+void StreamWrap<T>::cork_write(v8::Local<v8::Value> data, v8::Local<v8::Value> cb) {
+    // first write of this iteration, the request keeps us alive until flushed
+    if (!_corked_req) {
+        _corked_req = new WriteReq(this, v8::Array::New());
+        CorkFlusher::ForLoop(this->_handle->loop)->Schedule(this);
+    }
 
-    // if we only send back one array this will be faster
+    std::vector<uv_buf_t> bufs;
+    _corked_req->hold(WriteBuffers(data, bufs));
+    _corked_req->add_callback(cb);
 
-    const unsigned int num_bufs = arr->Length();
-    uv_buf_t bufs[num_bufs];
+    _corked_bufs.insert(_corked_bufs.end(), bufs.begin(), bufs.end());
+    for (size_t i = 0 ; i < bufs.size() ; ++i) {
+        _corked_bytes += bufs[i].len;
+    }
 
-    for (unsigned int i=0 ; i<num_bufs ; ++i) {
-        v8::Local<v8::Value> val = arr->Get(i);
-        assert(val->IsArrayBuffer());
+    check_high_watermark();
+}
+
+template <typename T>
+void StreamWrap<T>::flush() {
+    if (!_corked_req) {
+        return;
+    }
 
-        v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(val);
+    CorkFlusher::ForLoop(this->_handle->loop)->Cancel(this);
+
+    WriteReq* write_req = _corked_req;
+    _corked_req = 0;
+
+    std::vector<uv_buf_t> bufs;
+    bufs.swap(_corked_bufs);
+    _corked_bytes = 0;
+
+    // only empty arrays were written
+    if (bufs.empty()) {
+        write_req->Done(0);
+        delete write_req;
+        return;
+    }
+
+    const int written = try_write(&bufs[0], bufs.size());
+    if (written < 0 && written != UV_EAGAIN) {
+        write_req->Done(written);
+        delete write_req;
+        return;
+    }
 
-        bufs[i].base = static_cast<char*>(Externalized(ab));
-        bufs[i].len = ab->ByteLength();
+    if (written > 0) {
+        touch();
     }
 
-#endif
+    const size_t first = ConsumeBuffers(bufs, written > 0 ? written : 0);
+    if (first == bufs.size()) {
+        write_req->Done(0);
+        check_low_watermark();
+        delete write_req;
+        return;
+    }
+
+    uv_write_t* req = new uv_write_t;
+    req->data = write_req;
+
+    const int err = write(req, &bufs[first], bufs.size() - first);
+    if (err) {
+        delete req;
+        write_req->Done(err);
+        delete write_req;
+        return;
+    }
+
+    check_high_watermark();
 }
 
 template <typename T>
@@ -225,14 +940,19 @@ void StreamWrap<T>::Write_Cb(uv_write_t* req, int status) {
     v8::HandleScope handle_scope(isolate);
 
     WriteReq* write_req = static_cast<WriteReq*>(req->data);
+    StreamWrap<uv_stream_t>* wrap = static_cast<StreamWrap<uv_stream_t> *>(req->handle->data);
     delete req;
 
-    if (!write_req->write_callback().IsEmpty()) {
-        const int argc = 1;
-        v8::Local<v8::Value> argv[argc] = { v8::Integer::New(status) };
-        write_req->write_callback().Call(argc, argv);
+    --wrap->_writes_pending;
+
+    if (status == 0) {
+        wrap->touch();
     }
 
+    write_req->Done(status);
+
+    // the request still holds a reference to the stream here
+    wrap->check_low_watermark();
     delete write_req;
 }
 
@@ -257,3 +977,6 @@ void StreamWrap<T>::After_Listen(uv_stream_t* server, int status) {
 
 } // namespace detail
 } // namespace uvjs
+
+// native stream to stream forwarding
+#include "stream_pipe.h"
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <assert.h>
+#include <v8.h>
+#include <uv.h>
+
+#include "statics.h"
+
+namespace uvjs {
+namespace detail {
+
+// object templates shared by every instance of a wrapper type
+enum TemplateKind {
+    kLoopTemplate,
+    kTimerTemplate,
+    kTimerWheelTemplate,
+    kTcpTemplate,
+    kTtyTemplate,
+    kWorkerTemplate,
+    kHandoffTemplate,
+    kAsyncTemplate,
+    kAsyncSenderTemplate,
+    kTemplateCount
+};
+
+// Templates holds one ObjectTemplate per wrapper type for each isolate
+//
+// templates are built once when uvjs::New() runs, so every instance of a type
+// shares the same function objects and hidden class instead of getting new
+// ones for each handle.
+//
+// an isolate is only ever used from the thread which runs it (see workers)
+// so the templates are kept in thread local storage, no locking needed.
+class Templates {
+public:
+    // register the template for kind on the current isolate
+    static void Set(TemplateKind kind, v8::Handle<v8::ObjectTemplate> tmpl) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        Current()->_templates[kind].Reset(isolate, tmpl);
+    }
+
+    // the template for kind on the current isolate
+    // should be called within a handle scope
+    static v8::Local<v8::ObjectTemplate> Get(TemplateKind kind) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+
+        v8::Persistent<v8::ObjectTemplate>& tmpl = Current()->_templates[kind];
+        assert(!tmpl.IsEmpty() && "uvjs::New() was not called on this isolate");
+
+        return v8::Local<v8::ObjectTemplate>::New(isolate, tmpl);
+    }
+
+private:
+    static Templates* Current() {
+        Templates* templates = ThreadLocal<Templates>::Get();
+        if (!templates) {
+            templates = new Templates();
+            ThreadLocal<Templates>::Set(templates);
+        }
+
+        return templates;
+    }
+
+    v8::Persistent<v8::ObjectTemplate> _templates[kTemplateCount];
+};
+
+} // namespace detail
+} // namespace uvjs
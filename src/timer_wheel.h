@@ -0,0 +1,518 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <v8.h>
+#include <uv.h>
+
+#include <vector>
+
+#include "handle_wrap.h"
+#include "callback.h"
+#include "unwrap.h"
+#include "throw.h"
+#include "templates.h"
+
+namespace uvjs {
+namespace detail {
+
+// TimerWheel multiplexes many timeouts onto a single uv_timer_t
+//
+// meant for per connection timeouts which are mostly cancelled before they fire.
+// a timeout is a plain integer id, no js object or persistent is created for it.
+// expired timeouts are reported in one callback with the tokens given to add().
+//
+// timeouts live in a hierarchical wheel of 4 levels of 64 slots with 1ms ticks.
+// a timeout sits on the level of the highest 6 bit digit where its expiry differs
+// from the current tick. When the current tick reaches a slot on a higher level
+// that slot is cascaded down. Insert and cancel are O(1), the backing uv timer
+// is only started for the next tick where something has to happen.
+//
+// closing the wheel drops every pending timeout, add() throws afterwards and
+// cancel() returns false.
+class TimerWheel : public HandleWrap<uv_timer_t> {
+public:
+    static const int kBits = 6;
+    static const int kSlots = 1 << kBits;
+    static const int kLevels = 4;
+
+    // ids are index | generation << kIndexBits and stay small integers in js
+    static const int kIndexBits = 22;
+    static const uint32_t kIndexMask = (1 << kIndexBits) - 1;
+    static const uint32_t kNil = 0xffffffff;
+
+    TimerWheel() : HandleWrap<uv_timer_t>(), _current(0), _scheduled(0), _clock_offset(0),
+        _count(0), _free(kNil), _refed(false) {
+
+        for (int l = 0 ; l < kLevels ; ++l) {
+            _level_count[l] = 0;
+            for (int s = 0 ; s < kSlots ; ++s) {
+                _slots[l][s] = kNil;
+            }
+        }
+    }
+
+    int init(uv_loop_t* loop) {
+        return uv_timer_init(loop, _handle);
+    }
+
+    Callback& callback() {
+        return _cb;
+    }
+
+    // token is reported when the timeout expires in ms milliseconds
+    // returns the id for cancel
+    uint32_t add(uint32_t ms, int32_t token) {
+        const uint64_t now = Now();
+
+        // idle wheel, nothing to catch up on
+        if (_count == 0) {
+            _current = now;
+        }
+
+        uint32_t index = _free;
+        if (index == kNil) {
+            index = _entries.size();
+            assert(index <= kIndexMask);
+            _entries.push_back(Entry());
+        }
+        else {
+            _free = _entries[index].next;
+        }
+
+        Entry& entry = _entries[index];
+        entry.when = now + (ms ? ms : 1);
+        entry.token = token;
+        entry.active = true;
+
+        Insert(index);
+        ++_count;
+        UpdateRef();
+
+        if (!uv_is_active(reinterpret_cast<uv_handle_t*>(_handle)) || entry.when < _scheduled) {
+            Schedule();
+        }
+
+        return index | (static_cast<uint32_t>(entry.gen) << kIndexBits);
+    }
+
+    // returns false if the timeout already expired or was cancelled
+    bool cancel(uint32_t id) {
+        const uint32_t index = id & kIndexMask;
+        if (index >= _entries.size()) {
+            return false;
+        }
+
+        Entry& entry = _entries[index];
+        if (!entry.active || entry.gen != (id >> kIndexBits)) {
+            return false;
+        }
+
+        Unlink(index);
+        Release(index);
+
+        // an early wakeup with nothing to do is cheaper than rescheduling here
+        if (--_count == 0) {
+            uv_timer_stop(_handle);
+        }
+
+        UpdateRef();
+
+        return true;
+    }
+
+    // the backing timer is gone, forget every pending timeout
+    void Closed() {
+        _entries.clear();
+        _free = kNil;
+        _count = 0;
+
+        for (int l = 0 ; l < kLevels ; ++l) {
+            _level_count[l] = 0;
+            for (int s = 0 ; s < kSlots ; ++s) {
+                _slots[l][s] = kNil;
+            }
+        }
+
+        // still refed by close, this is not the last reference
+        UpdateRef();
+    }
+
+    // testing only, move the wheel clock so it reads ms now
+    // lets tests cross digit boundaries of the wheel without waiting for them
+    void set_clock(uint64_t ms) {
+        assert(_count == 0);
+        _clock_offset = ms - uv_now(_handle->loop);
+    }
+
+private:
+    struct Entry {
+        Entry() : next(kNil), prev(kNil), when(0), token(0), gen(0),
+            level(0), slot(0), active(false) {}
+
+        uint32_t next;
+        uint32_t prev;
+        uint64_t when;
+        int32_t token;
+        uint8_t gen;
+        uint8_t level;
+        uint8_t slot;
+        bool active;
+    };
+
+    // stay alive for the callback while timeouts are pending
+    void UpdateRef() {
+        if (_count > 0 && !_refed) {
+            _refed = true;
+            this->Ref();
+        }
+        else if (_count == 0 && _refed) {
+            _refed = false;
+            this->Unref();
+        }
+    }
+
+    // tick at which slot on level is cascaded or expired
+    // only valid for slots after the current digit of that level
+    uint64_t SlotTime(int level, int slot) const {
+        const int shift = kBits * (level + 1);
+        return ((_current >> shift) << shift) + (static_cast<uint64_t>(slot) << (kBits * level));
+    }
+
+    void Insert(uint32_t index) {
+        Entry& entry = _entries[index];
+
+        if (entry.when <= _current) {
+            entry.when = _current + 1;
+        }
+
+        // level of the highest digit where expiry and current tick differ
+        int level = 0;
+        while (level < kLevels - 1 &&
+                (entry.when >> (kBits * (level + 1))) != (_current >> (kBits * (level + 1)))) {
+            ++level;
+        }
+
+        int slot = (entry.when >> (kBits * level)) & (kSlots - 1);
+
+        // beyond the top level, park in the last top level slot and cascade again
+        // an expiry which only crosses a top level boundary keeps its real slot
+        if (entry.when - _current >= (static_cast<uint64_t>(1) << (kBits * kLevels))) {
+            slot = ((_current >> (kBits * level)) - 1) & (kSlots - 1);
+        }
+
+        entry.level = level;
+        entry.slot = slot;
+        entry.prev = kNil;
+        entry.next = _slots[level][slot];
+
+        if (entry.next != kNil) {
+            _entries[entry.next].prev = index;
+        }
+
+        _slots[level][slot] = index;
+        ++_level_count[level];
+    }
+
+    void Unlink(uint32_t index) {
+        Entry& entry = _entries[index];
+
+        if (entry.prev != kNil) {
+            _entries[entry.prev].next = entry.next;
+        }
+        else {
+            _slots[entry.level][entry.slot] = entry.next;
+        }
+
+        if (entry.next != kNil) {
+            _entries[entry.next].prev = entry.prev;
+        }
+
+        --_level_count[entry.level];
+    }
+
+    void Release(uint32_t index) {
+        Entry& entry = _entries[index];
+        entry.active = false;
+        ++entry.gen;
+        entry.next = _free;
+        _free = index;
+    }
+
+    // move the wheel up to now, collecting the tokens of expired timeouts
+    void Advance(uint64_t now, std::vector<int32_t>* expired) {
+        while (_current < now) {
+            // skip ahead over empty lower levels
+            int empty = 0;
+            while (empty < kLevels && _level_count[empty] == 0) {
+                ++empty;
+            }
+
+            if (empty == kLevels) {
+                _current = now;
+                break;
+            }
+
+            if (empty > 0) {
+                const uint64_t mask = (static_cast<uint64_t>(1) << (kBits * empty)) - 1;
+                const uint64_t skip = _current | mask;
+                if (skip >= now) {
+                    _current = now;
+                    break;
+                }
+
+                _current = skip;
+            }
+
+            ++_current;
+
+            // cascade every level whose digit just rolled over, highest first
+            int top = 0;
+            while (top < kLevels - 1 &&
+                    (_current & ((static_cast<uint64_t>(1) << (kBits * (top + 1))) - 1)) == 0) {
+                ++top;
+            }
+
+            for (int level = top ; level > 0 ; --level) {
+                const int slot = (_current >> (kBits * level)) & (kSlots - 1);
+                Cascade(level, slot, expired);
+            }
+
+            Expire(_current & (kSlots - 1), expired);
+        }
+    }
+
+    void Cascade(int level, int slot, std::vector<int32_t>* expired) {
+        uint32_t index = _slots[level][slot];
+        _slots[level][slot] = kNil;
+
+        while (index != kNil) {
+            const uint32_t next = _entries[index].next;
+            --_level_count[level];
+
+            if (_entries[index].when <= _current) {
+                Fire(index, expired);
+            }
+            else {
+                Insert(index);
+            }
+
+            index = next;
+        }
+    }
+
+    void Expire(int slot, std::vector<int32_t>* expired) {
+        uint32_t index = _slots[0][slot];
+        _slots[0][slot] = kNil;
+
+        while (index != kNil) {
+            const uint32_t next = _entries[index].next;
+            --_level_count[0];
+
+            Fire(index, expired);
+            index = next;
+        }
+    }
+
+    void Fire(uint32_t index, std::vector<int32_t>* expired) {
+        expired->push_back(_entries[index].token);
+        Release(index);
+        --_count;
+    }
+
+    // next tick where a slot expires or cascades
+    // lower levels always come due before higher ones
+    uint64_t NextTick() const {
+        for (int level = 0 ; level < kLevels ; ++level) {
+            if (_level_count[level] == 0) {
+                continue;
+            }
+
+            const int digit = (_current >> (kBits * level)) & (kSlots - 1);
+            for (int i = 1 ; i <= kSlots ; ++i) {
+                const int slot = (digit + i) & (kSlots - 1);
+                if (_slots[level][slot] == kNil) {
+                    continue;
+                }
+
+                // wrapped past the top, the slot is only reached next revolution
+                if (slot <= digit) {
+                    const int shift = kBits * (level + 1);
+                    return SlotTime(level, slot) + (static_cast<uint64_t>(1) << shift);
+                }
+
+                return SlotTime(level, slot);
+            }
+        }
+
+        assert(false);
+        return _current + 1;
+    }
+
+    // wheel ticks, the loop time unless moved by set_clock
+    uint64_t Now() const {
+        return uv_now(_handle->loop) + _clock_offset;
+    }
+
+    // start the backing timer for the next tick with work
+    void Schedule() {
+        if (_count == 0) {
+            uv_timer_stop(_handle);
+            return;
+        }
+
+        const uint64_t now = Now();
+        _scheduled = NextTick();
+
+        uv_timer_start(_handle, After_Timer, _scheduled > now ? _scheduled - now : 0, 0);
+    }
+
+    static void After_Timer(uv_timer_t* handle, int status) {
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+        MetricsPhase phase(LoopMetrics::kPhaseTimer);
+
+        TimerWheel* wheel = static_cast<TimerWheel*>(handle->data);
+
+        // the callback might cancel or expire everything, stay alive until we return
+        wheel->Ref();
+
+        std::vector<int32_t> expired;
+        wheel->Advance(wheel->Now(), &expired);
+        wheel->Schedule();
+
+        if (!expired.empty()) {
+            v8::Local<v8::Array> tokens = v8::Array::New(expired.size());
+            for (size_t i = 0 ; i < expired.size() ; ++i) {
+                tokens->Set(i, v8::Integer::New(expired[i]));
+            }
+
+            const int argc = 1;
+            v8::Local<v8::Value> argv[argc] = { tokens };
+            wheel->callback().Call(argc, argv);
+        }
+
+        wheel->UpdateRef();
+        wheel->Unref();
+    }
+
+    // last tick processed, every pending timeout expires after it
+    uint64_t _current;
+
+    // tick the backing timer fires at
+    uint64_t _scheduled;
+
+    // added to the loop time, see set_clock
+    uint64_t _clock_offset;
+
+    uint32_t _count;
+    uint32_t _level_count[kLevels];
+
+    // heads of the slot lists, indices into _entries
+    uint32_t _slots[kLevels][kSlots];
+
+    std::vector<Entry> _entries;
+    uint32_t _free;
+
+    bool _refed;
+
+    Callback _cb;
+};
+
+// add(ms, token) -> id
+void Timer_Wheel_Add(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[0]->IsUint32());
+    assert(args[1]->IsInt32());
+
+    TimerWheel* wheel = Unwrap<TimerWheel>(args.This());
+
+    if (uv_is_closing(wheel->uv_handle())) {
+        v8::Local<v8::String> message = v8::String::NewFromUtf8(args.GetIsolate(),
+                "closed");
+        args.GetIsolate()->ThrowException(v8::Exception::Error(message));
+        return;
+    }
+
+    const uint32_t id = wheel->add(args[0]->Uint32Value(), args[1]->Int32Value());
+
+    args.GetReturnValue().Set(v8::Integer::NewFromUnsigned(id));
+}
+
+// cancel(id) -> true if the timeout was pending
+void Timer_Wheel_Cancel(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 1);
+    assert(args[0]->IsUint32());
+
+    TimerWheel* wheel = Unwrap<TimerWheel>(args.This());
+
+    // closing dropped every timeout
+    if (uv_is_closing(wheel->uv_handle())) {
+        args.GetReturnValue().Set(v8::Boolean::New(false));
+        return;
+    }
+
+    args.GetReturnValue().Set(v8::Boolean::New(wheel->cancel(args[0]->Uint32Value())));
+}
+
+// _set_clock(ms)
+//
+// testing only, the wheel reads ms as the current time from now on
+// the wheel must have no pending timeouts
+void Timer_Wheel_Set_Clock(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 1);
+    assert(args[0]->IsNumber());
+
+    TimerWheel* wheel = Unwrap<TimerWheel>(args.This());
+    wheel->set_clock(static_cast<uint64_t>(args[0]->IntegerValue()));
+}
+
+// template for timer wheels, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> TimerWheelTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    TimerWheel::Mixin(obj);
+
+    obj->Set(v8::String::NewSymbol("add"), v8::FunctionTemplate::New(Timer_Wheel_Add));
+    obj->Set(v8::String::NewSymbol("cancel"), v8::FunctionTemplate::New(Timer_Wheel_Cancel));
+    obj->Set(v8::String::NewSymbol("_set_clock"), v8::FunctionTemplate::New(Timer_Wheel_Set_Clock));
+
+    return handle_scope.Close(obj);
+}
+
+// timer_wheel_init(loop, cb) -> cb([token, ...])
+//
+// one wheel per loop is enough for any number of timeouts
+void timer_wheel_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[1]->IsFunction());
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+
+    TimerWheel* wheel = new TimerWheel();
+
+    const int err = wheel->init(loop);
+    if (err) {
+        delete wheel;
+        return UVThrow(err);
+    }
+
+    v8::Local<v8::Object> instance = Templates::Get(kTimerWheelTemplate)->NewInstance();
+    wheel->Wrap(instance);
+    wheel->callback().Reset(args[1]);
+
+    args.GetReturnValue().Set(instance);
+}
+
+} // namespace detail
+} // namespace uvjs
@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include <v8.h>
 
 #include "uvjs.h"
@@ -7,6 +8,9 @@
 #include "uvjs_tty.h"
 #include "uvjs_timer.h"
 #include "uvjs_fs.h"
+#include "uvjs_mmap.h"
+#include "uvjs_worker.h"
+#include "uvjs_async.h"
 //#include "uvjs_process.h"
 
 #include "internal.h"
@@ -17,10 +21,41 @@ void SetArrayBufferAllocator(uvjs::ArrayBufferAllocator* allocator) {
     uvjs::detail::allocator = allocator;
 }
 
+void SetWorkerGlobalCallback(uvjs::WorkerGlobalCallback callback) {
+    uvjs::detail::worker_global = callback;
+}
+
+AsyncQueue* AsyncRetain(v8::Handle<v8::Value> async) {
+    AsyncQueue* queue = uvjs::detail::Unwrap<uvjs::detail::AsyncWrap>(async)->queue();
+    queue->Retain();
+    return queue;
+}
+
+int AsyncSend(AsyncQueue* queue, void* data, size_t len) {
+    return queue->Send(data, len);
+}
+
+void AsyncRelease(AsyncQueue* queue) {
+    queue->Release();
+}
+
 v8::Handle<v8::ObjectTemplate> New() {
 
     v8::Handle<v8::ObjectTemplate> uv = v8::ObjectTemplate::New();
 
+    // handle templates are shared by every instance created on this isolate
+    uvjs::detail::Templates::Set(uvjs::detail::kLoopTemplate, uvjs::detail::LoopTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kTimerTemplate, uvjs::detail::TimerTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kTimerWheelTemplate,
+            uvjs::detail::TimerWheelTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kTcpTemplate, uvjs::detail::TcpTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kTtyTemplate, uvjs::detail::TtyTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kWorkerTemplate, uvjs::detail::WorkerTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kHandoffTemplate, uvjs::detail::HandoffTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kAsyncTemplate, uvjs::detail::AsyncTemplate());
+    uvjs::detail::Templates::Set(uvjs::detail::kAsyncSenderTemplate,
+            uvjs::detail::AsyncSenderTemplate());
+
     // functions
 #define PROP(str) uv->Set(v8::String::New(#str), v8::FunctionTemplate::New(uvjs::detail::str));
 
@@ -29,6 +64,7 @@ v8::Handle<v8::ObjectTemplate> New() {
     PROP(version_string);
     PROP(strerror);
     PROP(err_name);
+    PROP(hrtime);
 
     // loop
     PROP(loop_new);
@@ -40,14 +76,27 @@ v8::Handle<v8::ObjectTemplate> New() {
     PROP(backend_fd);
     PROP(backend_timeout);
     PROP(now);
+    PROP(metrics_start);
+    PROP(metrics_stop);
+    PROP(watchdog_start);
+    PROP(watchdog_stop);
+    PROP(walk);
 
     // timers
     PROP(timer_init);
+    PROP(timer_wheel_init);
 
     // streams
     PROP(tcp_init);
     PROP(tty_init);
 
+    // connection handoff between loops
+    PROP(handoff_init);
+
+    // cross thread wakeups
+    PROP(async_init);
+    PROP(async_sender);
+
     // process
     //PROP(spawn);
 
@@ -55,8 +104,21 @@ v8::Handle<v8::ObjectTemplate> New() {
     PROP(fs_open);
     PROP(fs_close);
     PROP(fs_read);
+    PROP(fs_write);
+    PROP(fs_read_file);
+#if !defined(_WIN32)
+    PROP(fs_mmap);
+    PROP(fs_munmap);
+    PROP(fs_madvise);
+#endif
+    PROP(fs_stat);
+    PROP(fs_lstat);
+    PROP(fs_fstat);
     PROP(fs_readdir);
 
+    // workers
+    PROP(worker_spawn);
+
 #undef PROP
 
     // enums
@@ -84,8 +146,86 @@ v8::Handle<v8::ObjectTemplate> New() {
     ENUM(UV_READABLE_PIPE);
     ENUM(UV_WRITABLE_PIPE);
 
+    // fs_open flags
+    ENUM(O_RDONLY);
+    ENUM(O_WRONLY);
+    ENUM(O_RDWR);
+    ENUM(O_CREAT);
+    ENUM(O_TRUNC);
+    ENUM(O_APPEND);
+
 #undef ENUM
 
+    // stream write completed inline, no callback will follow
+    uv->Set(v8::String::New("UVJS_WRITE_DONE"), v8::Integer::New(uvjs::detail::kWriteDone));
+
+    // loop metrics layout, see loop_metrics.h
+#define METRIC(name, value) uv->Set(v8::String::New("UVJS_METRICS_" #name), v8::Integer::New(value));
+
+    METRIC(ITERATIONS, uvjs::detail::LoopMetrics::kIterations);
+    METRIC(POLL_TIME, uvjs::detail::LoopMetrics::kPollTime);
+    METRIC(JS_POLL_TIME, uvjs::detail::LoopMetrics::kJsPollTime);
+    METRIC(JS_TIMER_TIME, uvjs::detail::LoopMetrics::kJsTimerTime);
+    METRIC(JS_CHECK_TIME, uvjs::detail::LoopMetrics::kJsCheckTime);
+    METRIC(JS_CLOSE_TIME, uvjs::detail::LoopMetrics::kJsCloseTime);
+    METRIC(CALLBACKS, uvjs::detail::LoopMetrics::kCallbacks);
+    METRIC(LAG_TIME, uvjs::detail::LoopMetrics::kLagTime);
+
+    // histograms follow the counters, each has the same number of buckets
+    METRIC(HISTOGRAMS, uvjs::detail::LoopMetrics::kCounterCount);
+    METRIC(BUCKETS, uvjs::detail::LoopMetrics::kBuckets);
+    METRIC(HIST_POLL, uvjs::detail::LoopMetrics::kHistPoll);
+    METRIC(HIST_JS_POLL, uvjs::detail::LoopMetrics::kHistJsPoll);
+    METRIC(HIST_JS_TIMER, uvjs::detail::LoopMetrics::kHistJsTimer);
+    METRIC(HIST_JS_CHECK, uvjs::detail::LoopMetrics::kHistJsCheck);
+    METRIC(HIST_JS_CLOSE, uvjs::detail::LoopMetrics::kHistJsClose);
+    METRIC(HIST_LAG, uvjs::detail::LoopMetrics::kHistLag);
+    METRIC(HIST_CALLBACKS, uvjs::detail::LoopMetrics::kHistCallbacks);
+
+#undef METRIC
+
+    // handoff target selection
+    uv->Set(v8::String::New("UVJS_HANDOFF_ROUND_ROBIN"),
+            v8::Integer::New(uvjs::detail::kHandoffRoundRobin));
+    uv->Set(v8::String::New("UVJS_HANDOFF_LEAST_LOAD"),
+            v8::Integer::New(uvjs::detail::kHandoffLeastLoad));
+
+#if !defined(_WIN32)
+    // fs_mmap modes and advice, see uvjs_mmap.h
+    uv->Set(v8::String::New("UVJS_MMAP_READ"), v8::Integer::New(uvjs::detail::kMmapRead));
+    uv->Set(v8::String::New("UVJS_MMAP_SHARED"), v8::Integer::New(uvjs::detail::kMmapShared));
+
+    uv->Set(v8::String::New("UVJS_MADV_NORMAL"), v8::Integer::New(uvjs::detail::kAdviceNormal));
+    uv->Set(v8::String::New("UVJS_MADV_SEQUENTIAL"),
+            v8::Integer::New(uvjs::detail::kAdviceSequential));
+    uv->Set(v8::String::New("UVJS_MADV_RANDOM"), v8::Integer::New(uvjs::detail::kAdviceRandom));
+    uv->Set(v8::String::New("UVJS_MADV_WILLNEED"),
+            v8::Integer::New(uvjs::detail::kAdviceWillNeed));
+    uv->Set(v8::String::New("UVJS_MADV_DONTNEED"),
+            v8::Integer::New(uvjs::detail::kAdviceDontNeed));
+#endif
+
+    // fs_stat array layout, see uvjs_fs.h
+#define STAT(name, value) uv->Set(v8::String::New("UVJS_STAT_" #name), v8::Integer::New(value));
+
+    STAT(DEV, uvjs::detail::kStatDev);
+    STAT(MODE, uvjs::detail::kStatMode);
+    STAT(NLINK, uvjs::detail::kStatNlink);
+    STAT(UID, uvjs::detail::kStatUid);
+    STAT(GID, uvjs::detail::kStatGid);
+    STAT(RDEV, uvjs::detail::kStatRdev);
+    STAT(INO, uvjs::detail::kStatIno);
+    STAT(SIZE, uvjs::detail::kStatSize);
+    STAT(BLKSIZE, uvjs::detail::kStatBlksize);
+    STAT(BLOCKS, uvjs::detail::kStatBlocks);
+    STAT(ATIME, uvjs::detail::kStatAtime);
+    STAT(MTIME, uvjs::detail::kStatMtime);
+    STAT(CTIME, uvjs::detail::kStatCtime);
+    STAT(BIRTHTIME, uvjs::detail::kStatBirthtime);
+    STAT(LENGTH, uvjs::detail::kStatLength);
+
+#undef STAT
+
     return uv;
 }
 
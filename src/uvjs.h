@@ -15,6 +15,9 @@ namespace uvjs {
 // some sort of Watchdog class pointer in one of the internal fields of the ArrayBuffer
 // so that the externalized data pointer can be accessed again when needed.
 //
+// Allocate, AllocateUninitialized and Free must be thread safe, uvjs allocates
+// on threadpool threads (fs_read_file) and frees memory sent between threads.
+//
 class ArrayBufferAllocator : public v8::ArrayBuffer::Allocator {
 public:
     // return the void* for the ArrayBuffer contents
@@ -29,6 +32,32 @@ public:
     // bytes which have been allocated with the Allocate(size_t len) method of
     // the v8 Allocator baseclass
     virtual v8::Local<v8::ArrayBuffer> Externalize(void* buf, size_t bytes) = 0;
+
+    // hands back memory which did not come from Allocate (a file mapping)
+    typedef void (*ReleaseCallback)(void* buf, size_t bytes);
+
+    // same as above for memory uvjs got elsewhere, release is called with
+    // buf and bytes instead of Free once the ArrayBuffer is collected
+    virtual v8::Local<v8::ArrayBuffer> Externalize(void* buf, size_t bytes,
+            ReleaseCallback release) = 0;
+
+    // take ownership of the contents of the ArrayBuffer away from it
+    // externalize it first if needed, then make sure the memory is no longer
+    // freed when the ArrayBuffer is collected. uvjs neuters the buffer afterwards
+    // and frees or re-externalizes the returned memory itself.
+    //
+    // used to move buffers between isolates without copying
+    virtual void* Release(v8::Local<v8::ArrayBuffer>& buffer) = 0;
+
+    // native code (a queued write, a threadpool read) is using the memory of
+    // the ArrayBuffer, externalize it first if needed. Pins are counted, uvjs
+    // unpins once for every pin and refuses to release or unmap pinned buffers.
+    // Typically a counter kept next to the data pointer in the Watchdog.
+    virtual void Pin(v8::Local<v8::ArrayBuffer>& buffer) = 0;
+    virtual void Unpin(v8::Local<v8::ArrayBuffer>& buffer) = 0;
+
+    // true if the ArrayBuffer has been pinned more often than unpinned
+    virtual bool Pinned(v8::Local<v8::ArrayBuffer>& buffer) = 0;
 };
 
 void SetArrayBufferAllocator(uvjs::ArrayBufferAllocator*);
@@ -44,4 +73,33 @@ void SetArrayBufferAllocator(uvjs::ArrayBufferAllocator*);
 //
 v8::Handle<v8::ObjectTemplate> New();
 
+// workers (uv.worker_spawn) run their own isolate on their own thread and hold
+// a v8::Locker on it. Once any isolate has been locked v8 requires a Locker for
+// every isolate that is entered, so an embedder which spawns workers must hold
+// a v8::Locker on its own isolate for as long as it runs js on it.
+//
+// return the global object template for a worker context
+// called on the worker thread within a HandleScope, before the worker script runs
+//
+// by default workers get a global with only __uv_bindings set, embedders can
+// use this to add their own functions (print, require, ...)
+typedef v8::Handle<v8::ObjectTemplate> (*WorkerGlobalCallback)();
+
+void SetWorkerGlobalCallback(WorkerGlobalCallback);
+
+// queue behind an async handle (uv.async_init), see uvjs_async.h
+class AsyncQueue;
+
+// retain the queue of an async handle object
+// call on the loop thread of the handle, the queue stays valid until released
+AsyncQueue* AsyncRetain(v8::Handle<v8::Value> async);
+
+// send len bytes at data to the async handle, callable from any thread
+// data must come from the ArrayBufferAllocator and is owned by the queue on success
+// fails with UV_EPIPE once the handle has been closed
+int AsyncSend(AsyncQueue* queue, void* data, size_t len);
+
+// release a queue from AsyncRetain, callable from any thread
+void AsyncRelease(AsyncQueue* queue);
+
 } // namespace uvjs
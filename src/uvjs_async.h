@@ -0,0 +1,473 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <v8.h>
+#include <uv.h>
+
+#include <map>
+
+#include "uvjs.h"
+#include "atomic.h"
+#include "buffer.h"
+#include "handle_wrap.h"
+#include "callback.h"
+#include "unwrap.h"
+#include "throw.h"
+#include "templates.h"
+#include "statics.h"
+#include "internal.h"
+
+namespace uvjs {
+
+// AsyncQueue carries messages from any thread to the loop of an async handle
+//
+// the queue is an intrusive multi producer single consumer queue (Vyukov).
+// producers link their message with a single atomic exchange, no locks. The loop
+// thread drains everything queued when it wakes up and hands the whole batch to
+// js in one callback.
+//
+// a wakeup is only requested by the producer which finds the queue unsignaled,
+// any further sends before the loop drains ride along on that same wakeup.
+//
+// the queue is reference counted, producers on other threads keep it alive
+// after the handle is closed, sends then fail with UV_EPIPE.
+class AsyncQueue {
+public:
+    AsyncQueue(uv_async_t* async)
+        : _async(async), _head(&_stub), _tail(&_stub),
+        _signaled(0), _senders(0), _closed(0), _refs(1) {
+        _stub.next = 0;
+    }
+
+    void Retain() {
+        detail::AtomicAdd(&_refs, 1);
+    }
+
+    void Release() {
+        if (detail::AtomicAdd(&_refs, -1) == 0) {
+            delete this;
+        }
+    }
+
+    // queue len bytes at data for the loop, callable from any thread
+    // data must come from the ArrayBufferAllocator, the queue takes ownership
+    int Send(void* data, size_t len) {
+        // close waits for senders to leave before closing the async handle
+        // pairs with the fence in Close, either we see the queue closed or
+        // Close sees us as a sender and waits
+        detail::AtomicAdd(&_senders, 1);
+        detail::AtomicFence();
+
+        if (detail::AtomicLoad(&_closed)) {
+            detail::AtomicAdd(&_senders, -1);
+            return UV_EPIPE;
+        }
+
+        Message* msg = new Message;
+        msg->data = data;
+        msg->len = len;
+        Push(msg);
+
+        int err = 0;
+        if (detail::AtomicExchange(&_signaled, 1L) == 0) {
+            err = uv_async_send(_async);
+        }
+
+        detail::AtomicAdd(&_senders, -1);
+        return err;
+    }
+
+    // drain all queued messages into an array of ArrayBuffers
+    // must be called on the loop thread within a HandleScope
+    v8::Local<v8::Array> Drain() {
+        // clear first, a send racing with the drain signals again
+        detail::AtomicExchange(&_signaled, 0L);
+
+        v8::Local<v8::Array> messages = v8::Array::New();
+
+        while (Message* msg = Pop()) {
+            messages->Set(messages->Length(),
+                    detail::allocator->Externalize(msg->data, msg->len));
+            delete msg;
+        }
+
+        return messages;
+    }
+
+    // refuse further sends, must be called on the loop thread before the
+    // async handle memory is released. Undelivered messages are freed.
+    void Close() {
+        detail::AtomicExchange(&_closed, 1L);
+        detail::AtomicFence();
+
+        // a sender which saw the queue open may still be signaling the handle
+        while (detail::AtomicLoad(&_senders)) {}
+
+        while (Message* msg = Pop()) {
+            detail::allocator->Free(msg->data, msg->len);
+            delete msg;
+        }
+    }
+
+private:
+    struct Message {
+        Message* volatile next;
+        void* data;
+        size_t len;
+    };
+
+    ~AsyncQueue() {
+        assert(_closed);
+    }
+
+    void Push(Message* msg) {
+        msg->next = 0;
+        Message* prev = detail::AtomicExchange(&_head, msg);
+        detail::AtomicStore(&prev->next, msg);
+    }
+
+    // consumer only, returns NULL when empty or a producer is mid push
+    // (that producer signals once it is done, so nothing is lost)
+    Message* Pop() {
+        Message* tail = _tail;
+        Message* next = detail::AtomicLoad(&tail->next);
+
+        if (tail == &_stub) {
+            if (!next) {
+                return 0;
+            }
+
+            _tail = next;
+            tail = next;
+            next = detail::AtomicLoad(&next->next);
+        }
+
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        if (tail != detail::AtomicLoad(&_head)) {
+            return 0;
+        }
+
+        // tail is the last message, put the stub behind it so it can be taken
+        Push(&_stub);
+
+        next = detail::AtomicLoad(&tail->next);
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        return 0;
+    }
+
+    uv_async_t* _async;
+
+    Message* volatile _head;
+    Message* _tail;
+    Message _stub;
+
+    volatile long _signaled;
+    volatile long _senders;
+    volatile long _closed;
+    volatile long _refs;
+};
+
+namespace detail {
+
+// async handles by id so js in other isolates can find them
+// only used when a sender is created, never when sending
+class AsyncRegistry : private StaticMutex<AsyncRegistry> {
+public:
+    static uint32_t Add(AsyncQueue* queue) {
+        Lock();
+        const uint32_t id = ++_next_id;
+        _queues[id] = queue;
+        Unlock();
+
+        return id;
+    }
+
+    static void Remove(uint32_t id) {
+        Lock();
+        _queues.erase(id);
+        Unlock();
+    }
+
+    // retained queue for id or NULL if there is no open handle with that id
+    static AsyncQueue* Retain(uint32_t id) {
+        Lock();
+
+        AsyncQueue* queue = 0;
+        std::map<uint32_t, AsyncQueue*>::iterator it = _queues.find(id);
+        if (it != _queues.end()) {
+            queue = it->second;
+            queue->Retain();
+        }
+
+        Unlock();
+        return queue;
+    }
+
+private:
+    static uint32_t _next_id;
+    static std::map<uint32_t, AsyncQueue*> _queues;
+};
+
+uint32_t AsyncRegistry::_next_id = 0;
+std::map<uint32_t, AsyncQueue*> AsyncRegistry::_queues;
+
+// send the contents of a js buffer through a queue
+//
+// the contents are copied unless transfer is set, then the ArrayBuffer is
+// neutered and its memory moves to the receiving isolate as is. File mappings
+// (UV_EINVAL) and buffers still in use natively (UV_EBUSY, pending writes and
+// reads or read data on the shared slab) can't be transferred, send copies
+inline int SendBuffer(AsyncQueue* queue, v8::Local<v8::Value> val, bool transfer) {
+    uv_buf_t buf;
+
+    if (transfer) {
+        assert(val->IsArrayBuffer());
+        const int err = TransferContents(v8::Local<v8::ArrayBuffer>::Cast(val), &buf);
+        if (err) {
+            return err;
+        }
+    }
+    else {
+        uv_buf_t contents;
+        BufferContents(val, &contents);
+
+        buf.base = static_cast<char*>(allocator->AllocateUninitialized(contents.len));
+        buf.len = contents.len;
+        memcpy(buf.base, contents.base, contents.len);
+    }
+
+    // the queue owns the memory once sent, otherwise nobody does
+    const int err = queue->Send(buf.base, buf.len);
+    if (err) {
+        allocator->Free(buf.base, buf.len);
+    }
+
+    return err;
+}
+
+// async wrap owns the uv_async_t and the queue feeding it
+class AsyncWrap : public HandleWrap<uv_async_t> {
+public:
+    AsyncWrap() : HandleWrap<uv_async_t>(), _queue(0), _id(0) {}
+
+    ~AsyncWrap() {
+        if (_queue) {
+            _queue->Release();
+        }
+    }
+
+    int init(uv_loop_t* loop) {
+        const int err = uv_async_init(loop, _handle, After_Async);
+        if (err) {
+            return err;
+        }
+
+        _queue = new AsyncQueue(_handle);
+        _id = AsyncRegistry::Add(_queue);
+        return 0;
+    }
+
+    AsyncQueue* queue() {
+        return _queue;
+    }
+
+    uint32_t id() const {
+        return _id;
+    }
+
+    Callback& callback() {
+        return _cb;
+    }
+
+    // stop accepting messages before the handle memory goes away
+    void Closed() {
+        AsyncRegistry::Remove(_id);
+        _queue->Close();
+    }
+
+private:
+    static void After_Async(uv_async_t* handle, int status) {
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+
+        AsyncWrap* wrap = static_cast<AsyncWrap*>(handle->data);
+
+        v8::Local<v8::Array> messages = wrap->queue()->Drain();
+        if (messages->Length() == 0) {
+            return;
+        }
+
+        const int argc = 1;
+        v8::Local<v8::Value> argv[argc] = { messages };
+        wrap->callback().Call(argc, argv);
+    }
+
+    AsyncQueue* _queue;
+    uint32_t _id;
+    Callback _cb;
+};
+
+// send(buffer, transfer)
+//
+// transfer moves an ArrayBuffer without copying, it is neutered in this isolate
+// and its memory is dropped if the send fails
+void Async_Send(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() >= 1);
+    assert(IsBuffer(args[0]));
+
+    AsyncWrap* wrap = Unwrap<AsyncWrap>(args.This());
+    const int err = SendBuffer(wrap->queue(), args[0], args[1]->BooleanValue());
+    args.GetReturnValue().Set(v8::Integer::New(err));
+}
+
+void Async_Id(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    AsyncWrap* wrap = Unwrap<AsyncWrap>(args.This());
+    args.GetReturnValue().Set(v8::Integer::NewFromUnsigned(wrap->id()));
+}
+
+void Async_Close(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 1);
+    assert(args[0]->IsFunction());
+
+    AsyncWrap* wrap = Unwrap<AsyncWrap>(args.This());
+
+    if (uv_is_closing(wrap->uv_handle())) {
+        v8::Local<v8::String> message = v8::String::NewFromUtf8(args.GetIsolate(),
+                "already closing");
+        args.GetIsolate()->ThrowException(v8::Exception::Error(message));
+        return;
+    }
+
+    wrap->close_callback().Reset(args[0]);
+    wrap->close();
+}
+
+// template for async handles, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> AsyncTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    obj->Set(v8::String::NewSymbol("send"), v8::FunctionTemplate::New(Async_Send));
+    obj->Set(v8::String::NewSymbol("id"), v8::FunctionTemplate::New(Async_Id));
+    obj->Set(v8::String::NewSymbol("close"), v8::FunctionTemplate::New(Async_Close));
+
+    return handle_scope.Close(obj);
+}
+
+// async_init(loop, cb) -> cb([ArrayBuffer, ...])
+//
+// messages sent from any thread are delivered on loop in batches
+// the handle keeps the loop alive until it is closed
+void async_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[1]->IsFunction());
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+
+    AsyncWrap* wrap = new AsyncWrap();
+
+    const int err = wrap->init(loop);
+    if (err) {
+        delete wrap;
+        return UVThrow(err);
+    }
+
+    v8::Local<v8::Object> instance = Templates::Get(kAsyncTemplate)->NewInstance();
+    wrap->Wrap(instance);
+    wrap->callback().Reset(args[1]);
+
+    // live for the callback until closed
+    wrap->Ref();
+
+    args.GetReturnValue().Set(instance);
+}
+
+// release the queue once the sender is collected
+static void WeakAsyncSender(v8::Isolate* isolate, v8::Persistent<v8::Object>* persistent,
+        AsyncQueue* queue) {
+
+    v8::HandleScope scope(isolate);
+    assert(queue);
+
+    if (persistent->IsEmpty()) {
+        return;
+    }
+
+    assert(persistent->IsNearDeath());
+    persistent->ClearWeak();
+    persistent->Dispose();
+
+    queue->Release();
+}
+
+// send(buffer, transfer), same as send on the async handle
+void Async_Sender_Send(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() >= 1);
+    assert(IsBuffer(args[0]));
+
+    AsyncQueue* queue = Unwrap<AsyncQueue>(args.This());
+    const int err = SendBuffer(queue, args[0], args[1]->BooleanValue());
+    args.GetReturnValue().Set(v8::Integer::New(err));
+}
+
+// template for async senders, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> AsyncSenderTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    obj->Set(v8::String::NewSymbol("send"), v8::FunctionTemplate::New(Async_Sender_Send));
+
+    return handle_scope.Close(obj);
+}
+
+// async_sender(id)
+//
+// sender for the async handle with id, usable from any isolate
+// throws if there is no open async handle with that id
+void async_sender(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 1);
+    assert(args[0]->IsUint32());
+
+    AsyncQueue* queue = AsyncRegistry::Retain(args[0]->Uint32Value());
+    if (!queue) {
+        return UVThrow(UV_ENOENT);
+    }
+
+    v8::Local<v8::Object> instance = Templates::Get(kAsyncSenderTemplate)->NewInstance();
+    instance->SetAlignedPointerInInternalField(0, queue);
+
+    v8::Persistent<v8::Object> persistent;
+    persistent.Reset(v8::Isolate::GetCurrent(), instance);
+    persistent.MakeWeak(queue, WeakAsyncSender);
+    persistent.MarkIndependent();
+
+    args.GetReturnValue().Set(instance);
+}
+
+} // namespace detail
+} // namespace uvjs
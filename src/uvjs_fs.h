@@ -1,10 +1,29 @@
 #pragma once
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
 #include "unwrap.h"
 #include "callback.h"
+#include "buffer.h"
+#include "internal.h"
 
 namespace uvjs {
 namespace detail {
@@ -82,7 +101,7 @@ v8::Local<v8::Object> BuildStatsObject(const uv_stat_t* s) {
         v8::Local<v8::Value> val = v8::Integer::New(s->st_##name, isolate);       \
         if (val.IsEmpty())                                                        \
         return v8::Local<v8::Object>();                                         \
-        stats->Set(v8::String::New("##name"), val);                                  \
+        stats->Set(v8::String::New(#name), val);                                     \
     }
     X(dev)
         X(mode)
@@ -100,7 +119,7 @@ v8::Local<v8::Object> BuildStatsObject(const uv_stat_t* s) {
             v8::Local<v8::Value> val = v8::Number::New(static_cast<double>(s->st_##name));\
             if (val.IsEmpty())                                                        \
             return v8::Local<v8::Object>();                                         \
-            stats->Set(v8::String::New("##name"), val);                                  \
+            stats->Set(v8::String::New(#name), val);                                     \
         }
         X(ino)
         X(size)
@@ -116,7 +135,7 @@ v8::Local<v8::Object> BuildStatsObject(const uv_stat_t* s) {
             v8::Local<v8::Value> val = v8::Date::New(msecs);                          \
             if (val.IsEmpty())                                                        \
             return v8::Local<v8::Object>();                                         \
-            stats->Set(v8::String::New("##name"), val);                                 \
+            stats->Set(v8::String::New(#name), val);                                    \
         }
         X(atime, atim)
         X(mtime, mtim)
@@ -241,6 +260,194 @@ static void After(uv_fs_t* req) {
     delete cb;
 }
 
+// file position argument, null (or negative) for the current position
+// numbers are exact up to 2^53 which covers any file we will see
+inline int64_t FilePosition(v8::Local<v8::Value> val) {
+    if (val->IsNull() || val->IsUndefined()) {
+        return -1;
+    }
+
+    assert(val->IsNumber());
+    const double position = val->NumberValue();
+    return position < 0 ? -1 : static_cast<int64_t>(position);
+}
+
+#if defined(_WIN32)
+
+// no vectored io on windows, write the buffers one after the other
+inline int64_t WriteBuffersAt(uv_file fd, uv_buf_t* bufs, size_t count, int64_t position) {
+    if (position >= 0 && _lseeki64(fd, position, SEEK_SET) < 0) {
+        return -errno;
+    }
+
+    int64_t total = 0;
+    for (size_t i = 0 ; i < count ; ++i) {
+        const int n = _write(fd, bufs[i].base, static_cast<unsigned int>(bufs[i].len));
+        if (n < 0) {
+            return total > 0 ? total : -errno;
+        }
+
+        total += n;
+        if (static_cast<size_t>(n) < bufs[i].len) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+#else
+
+// one writev (pwritev with a position) for up to IOV_MAX buffers
+// uv_buf_t has the layout of struct iovec on unix
+inline int64_t WriteBuffersAt(uv_file fd, uv_buf_t* bufs, size_t count, int64_t position) {
+    const int iovcnt = static_cast<int>(std::min<size_t>(count, IOV_MAX));
+    const struct iovec* iov = reinterpret_cast<const struct iovec*>(bufs);
+
+    ssize_t n;
+    do {
+        if (position < 0) {
+            n = ::writev(fd, iov, iovcnt);
+        }
+        else {
+#if defined(__APPLE__)
+            // no pwritev, the first buffer is written and the rest continued by the caller
+            n = ::pwrite(fd, bufs[0].base, bufs[0].len, position);
+#else
+            n = ::pwritev(fd, iov, iovcnt, position);
+#endif
+        }
+    } while (n < 0 && errno == EINTR);
+
+    return n < 0 ? -errno : n;
+}
+
+#endif
+
+// write all of bufs at position (or the current position if negative)
+// short writes are continued, returns the bytes written or a negative error
+inline int64_t WriteFile(uv_file fd, std::vector<uv_buf_t>& bufs, int64_t position) {
+    int64_t total = 0;
+
+    // empty buffers are skipped up front, ConsumeBuffers drops the written ones
+    bufs.erase(bufs.begin(), bufs.begin() + ConsumeBuffers(bufs, 0));
+
+    while (!bufs.empty()) {
+        const int64_t n = WriteBuffersAt(fd, &bufs[0], bufs.size(),
+                position < 0 ? position : position + total);
+
+        if (n < 0) {
+            return total > 0 ? total : n;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        total += n;
+        bufs.erase(bufs.begin(), bufs.begin() + ConsumeBuffers(bufs, n));
+    }
+
+    return total;
+}
+
+// async fs_write, runs WriteFile on the threadpool
+// the uv_fs_write of this libuv only takes a single buffer
+struct FsWriteReq {
+    uv_work_t req;
+    uv_file fd;
+    int64_t position;
+    int64_t result;
+    std::vector<uv_buf_t> bufs;
+    v8::Persistent<v8::Object> buffers;
+    Callback cb;
+
+    static void Work(uv_work_t* req) {
+        FsWriteReq* write = static_cast<FsWriteReq*>(req->data);
+        write->result = WriteFile(write->fd, write->bufs, write->position);
+    }
+
+    static void After_Work(uv_work_t* req, int status) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        v8::HandleScope scope(isolate);
+
+        FsWriteReq* write = static_cast<FsWriteReq*>(req->data);
+        const int64_t result = status < 0 ? status : write->result;
+
+        const int argc = 2;
+        v8::Local<v8::Value> argv[argc];
+
+        if (result < 0) {
+            argv[0] = UVException(static_cast<int>(result), NULL);
+            argv[1] = v8::Undefined(isolate);
+        }
+        else {
+            argv[0] = Null(isolate);
+            argv[1] = v8::Number::New(static_cast<double>(result));
+        }
+
+        // done with the memory, the callback may transfer the buffers
+        PinBuffers(v8::Local<v8::Object>::New(isolate, write->buffers), false);
+
+        write->cb.Call(argc, argv);
+
+        write->buffers.Reset();
+        delete write;
+    }
+};
+
+// fs_write(loop, fd, buffer, position, cb)
+// fs_write(loop, fd, [buffer, ...], position, cb)
+//
+// all buffers go out with a single pwritev (writev if position is null)
+// returns the bytes written when cb is null, otherwise cb(err, written)
+void fs_write(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 5);
+    assert(args[1]->IsInt32());
+    assert(args[2]->IsArray() || IsBuffer(args[2]));
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+    const int fd = args[1]->Int32Value();
+    const int64_t position = FilePosition(args[3]);
+
+    // async
+    if (args[4]->IsFunction()) {
+        FsWriteReq* write = new FsWriteReq;
+        write->req.data = write;
+        write->fd = fd;
+        write->position = position;
+        write->result = 0;
+
+        // the buffers stay alive and pinned until the write is done
+        v8::Local<v8::Object> buffers = WriteBuffers(args[2], write->bufs);
+        write->buffers.Reset(args.GetIsolate(), buffers);
+        PinBuffers(buffers, true);
+        write->cb.Reset(args[4]);
+
+        const int err = uv_queue_work(loop, &write->req, FsWriteReq::Work, FsWriteReq::After_Work);
+        if (err < 0) {
+            FsWriteReq::After_Work(&write->req, err);
+        }
+
+        args.GetReturnValue().Set(v8::Integer::New(err));
+        return;
+    }
+
+    // SYNC
+    std::vector<uv_buf_t> bufs;
+    WriteBuffers(args[2], bufs);
+
+    const int64_t written = WriteFile(fd, bufs, position);
+    if (written < 0) {
+        v8::ThrowException(UVException(static_cast<int>(written), NULL));
+        return;
+    }
+
+    args.GetReturnValue().Set(v8::Number::New(static_cast<double>(written)));
+}
+
 void fs_readdir(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
@@ -400,64 +607,349 @@ void fs_close(const v8::FunctionCallbackInfo<v8::Value>& args) {
     args.GetReturnValue().Set(v8::Integer::New(req.result));
 }
 
+#if defined(_WIN32)
+
+typedef struct _stati64 FileStat;
+
+inline int FileOpen(const char* path) {
+    return _open(path, _O_RDONLY | _O_BINARY);
+}
+
+inline int FileFstat(int fd, FileStat* st) {
+    return _fstati64(fd, st);
+}
+
+inline int64_t FileRead(int fd, char* buf, size_t len) {
+    return _read(fd, buf, static_cast<unsigned int>(len < INT_MAX ? len : INT_MAX));
+}
+
+inline void FileClose(int fd) {
+    _close(fd);
+}
+
+#else
+
+typedef struct stat FileStat;
+
+inline int FileOpen(const char* path) {
+    int fd;
+    do {
+        fd = ::open(path, O_RDONLY);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+inline int FileFstat(int fd, FileStat* st) {
+    return ::fstat(fd, st);
+}
+
+inline int64_t FileRead(int fd, char* buf, size_t len) {
+    ssize_t n;
+    do {
+        n = ::read(fd, buf, len);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+inline void FileClose(int fd) {
+    ::close(fd);
+}
+
+#endif
+
+// read a file into a single allocation from the ArrayBufferAllocator
+//
+// the allocation is sized by fstat, files which report no size (/proc and the
+// like) are read in chunks and copied into place once their size is known.
+// the file may shrink while we read, len is what was actually read.
+// returns 0 or a negative error, data is owned by the caller on success
+inline int ReadWholeFile(const char* path, char** data, size_t* len) {
+    *data = NULL;
+    *len = 0;
+
+    const int fd = FileOpen(path);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    FileStat st;
+    if (FileFstat(fd, &st) < 0) {
+        const int err = -errno;
+        FileClose(fd);
+        return err;
+    }
+
+    if (static_cast<uint64_t>(st.st_size) > static_cast<size_t>(-1)) {
+        FileClose(fd);
+        return UV_ENOMEM;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+
+    if (size > 0) {
+        char* buf = static_cast<char*>(uvjs::detail::allocator->AllocateUninitialized(size));
+        if (!buf) {
+            FileClose(fd);
+            return UV_ENOMEM;
+        }
+
+        size_t nread = 0;
+        while (nread < size) {
+            const int64_t n = FileRead(fd, buf + nread, size - nread);
+            if (n < 0) {
+                const int err = -errno;
+                uvjs::detail::allocator->Free(buf, size);
+                FileClose(fd);
+                return err;
+            }
+
+            if (n == 0) {
+                break;
+            }
+
+            nread += n;
+        }
+
+        FileClose(fd);
+
+        *data = buf;
+        *len = nread;
+        return 0;
+    }
+
+    // unknown size
+    std::vector<char> chunks;
+    char chunk[64 * 1024];
+
+    for (;;) {
+        const int64_t n = FileRead(fd, chunk, sizeof(chunk));
+        if (n < 0) {
+            const int err = -errno;
+            FileClose(fd);
+            return err;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        chunks.insert(chunks.end(), chunk, chunk + n);
+    }
+
+    FileClose(fd);
+
+    if (chunks.empty()) {
+        return 0;
+    }
+
+    char* buf = static_cast<char*>(uvjs::detail::allocator->AllocateUninitialized(chunks.size()));
+    if (!buf) {
+        return UV_ENOMEM;
+    }
+
+    memcpy(buf, &chunks[0], chunks.size());
+
+    *data = buf;
+    *len = chunks.size();
+    return 0;
+}
+
+// the file contents as an externalized ArrayBuffer, must be called within a HandleScope
+inline v8::Local<v8::ArrayBuffer> FileBuffer(char* data, size_t len) {
+    if (!data) {
+        return v8::ArrayBuffer::New(0);
+    }
+
+    return uvjs::detail::allocator->Externalize(data, len);
+}
+
+// async fs_read_file, open through close happen in one threadpool request
+struct FsReadFileReq {
+    uv_work_t req;
+    std::string path;
+    char* data;
+    size_t len;
+    int result;
+    Callback cb;
+
+    static void Work(uv_work_t* req) {
+        FsReadFileReq* read = static_cast<FsReadFileReq*>(req->data);
+        read->result = ReadWholeFile(read->path.c_str(), &read->data, &read->len);
+    }
+
+    static void After_Work(uv_work_t* req, int status) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        v8::HandleScope scope(isolate);
+
+        FsReadFileReq* read = static_cast<FsReadFileReq*>(req->data);
+        const int result = status < 0 ? status : read->result;
+
+        const int argc = 2;
+        v8::Local<v8::Value> argv[argc];
+
+        if (result < 0) {
+            if (read->data) {
+                uvjs::detail::allocator->Free(read->data, read->len);
+            }
+
+            argv[0] = UVException(result, NULL);
+            argv[1] = v8::Undefined(isolate);
+        }
+        else {
+            argv[0] = Null(isolate);
+            argv[1] = FileBuffer(read->data, read->len);
+        }
+
+        read->cb.Call(argc, argv);
+        delete read;
+    }
+};
+
+// fs_read_file(loop, path, cb)
+//
+// the whole file in a single ArrayBuffer, sized by fstat
+// returns the buffer when cb is null, otherwise cb(err, buffer)
+void fs_read_file(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 3);
+    assert(args[1]->IsString());
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+    v8::String::Utf8Value path(args[1]);
+
+    // async
+    if (args[2]->IsFunction()) {
+        FsReadFileReq* read = new FsReadFileReq;
+        read->req.data = read;
+        read->path = *path;
+        read->data = NULL;
+        read->len = 0;
+        read->result = 0;
+        read->cb.Reset(args[2]);
+
+        const int err = uv_queue_work(loop, &read->req, FsReadFileReq::Work,
+                FsReadFileReq::After_Work);
+        if (err < 0) {
+            FsReadFileReq::After_Work(&read->req, err);
+        }
+
+        args.GetReturnValue().Set(v8::Integer::New(err));
+        return;
+    }
+
+    // SYNC
+    char* data;
+    size_t len;
+
+    const int err = ReadWholeFile(*path, &data, &len);
+    if (err < 0) {
+        v8::ThrowException(UVException(err, NULL));
+        return;
+    }
+
+    args.GetReturnValue().Set(FileBuffer(data, len));
+}
+
+// async read, holds on to the destination buffer (pinned) until the read is done
+struct FsReadReq {
+    uv_fs_t req;
+    Callback cb;
+    v8::Persistent<v8::ArrayBuffer> buffer;
+
+    static void After_Read(uv_fs_t* req) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        v8::HandleScope scope(isolate);
+
+        FsReadReq* read = static_cast<FsReadReq*>(req->data);
+
+        const int argc = 2;
+        v8::Local<v8::Value> argv[argc];
+
+        if (req->result < 0) {
+            argv[0] = UVException(*req);
+            argv[1] = v8::Undefined(isolate);
+        }
+        else {
+            argv[0] = Null(isolate);
+            argv[1] = v8::Number::New(static_cast<double>(req->result));
+        }
+
+        // done with the memory, the callback may transfer the buffer
+        v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::New(isolate, read->buffer);
+        uvjs::detail::allocator->Unpin(ab);
+
+        read->cb.Call(argc, argv);
+
+        uv_fs_req_cleanup(req);
+        read->buffer.Reset();
+        delete read;
+    }
+};
+
+// fs_read(loop, fd, buffer, position, cb)
+// fs_read(loop, fd, buffer, offset, length, position, cb)
+//
+// read into buffer (an ArrayBuffer or a view), or into length bytes of it
+// starting at offset. The memory is taken through the allocator so the same
+// buffer can be read into again and again, it stays usable from js throughout.
+// position is a file position or null for the current one
+// returns the bytes read when cb is null, otherwise cb(err, nread)
 void fs_read(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
-    assert(args.Length() == 5);
+    assert(args.Length() == 5 || args.Length() == 7);
     assert(args[1]->IsInt32());
-    assert(args[2]->IsArrayBuffer());
-    assert(args[3]->IsInt32());
+    assert(IsBuffer(args[2]));
 
     uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
     const int fd = args[1]->Int32Value();
-    const int offset = args[3]->Int32Value();
-
-    v8::Local<v8::ArrayBuffer> arr = v8::Local<v8::ArrayBuffer>::Cast(args[2]);
 
-    // TODO I think we need to make our own array buffers and pass them to the user
-    // array buffers cannot be externalized more than once
-    // and I don't see how we can store the contents to reuse safely
-    // we could use one of the array buffers internal fields
-    // however....if any other bindings decide to do so as well
-    // then they would be in their right and could step on our field
-    // this is not a safe solution since the array buffer is everyone's to create
-    v8::ArrayBuffer::Contents buf = arr->Externalize();
+    uv_buf_t buf;
+    v8::Local<v8::ArrayBuffer> ab = BufferContents(args[2], &buf);
 
-    // alternative!
-    // we allow user to create buffer via buf_init
-    // they pass this buffer to us
-    // we then callback... fuck.. no won't work for sync version
+    // window into the buffer
+    int pos_arg = 3;
+    if (args.Length() == 7) {
+        assert(args[3]->IsUint32());
+        assert(args[4]->IsUint32());
 
-    // TODO persistent for arr
-    // we need to attach ourselves to the ArrayBuffer
-    // so we cleanup the externalized memory when variable dies
-    // but we also need to prevent variable from dying if we need the memory
+        const size_t offset = args[3]->Uint32Value();
+        const size_t length = args[4]->Uint32Value();
+        assert(offset <= buf.len && length <= buf.len - offset);
 
-    // async
-    if (args[4]->IsFunction()) {
-
-        uv_fs_t* req = new uv_fs_t;
+        buf.base += offset;
+        buf.len = length;
+        pos_arg = 5;
+    }
 
-        Callback* cb = new Callback();
-        cb->Reset(args[4]);
-        req->data = cb;
+    const int64_t position = FilePosition(args[pos_arg]);
+    v8::Local<v8::Value> callback = args[pos_arg + 1];
 
-        const int err = uv_fs_read(loop, req, fd, buf.Data(), buf.ByteLength(), offset, After);
+    // async
+    if (callback->IsFunction()) {
+        FsReadReq* read = new FsReadReq;
+        read->req.data = read;
+        read->cb.Reset(callback);
+        read->buffer.Reset(args.GetIsolate(), ab);
+        uvjs::detail::allocator->Pin(ab);
+
+        const int err = uv_fs_read(loop, &read->req, fd, buf.base, buf.len, position,
+                FsReadReq::After_Read);
         if (err < 0) {
-            req->result = err;
-            req->path = NULL;
-            After(req);
+            read->req.result = err;
+            read->req.path = NULL;
+            FsReadReq::After_Read(&read->req);
         }
 
         args.GetReturnValue().Set(v8::Integer::New(err));
-
         return;
     }
 
     // SYNC
     uv_fs_t req;
 
-    const int err = uv_fs_read(loop, &req, fd, buf.Data(), buf.ByteLength(), offset, NULL);
+    const int err = uv_fs_read(loop, &req, fd, buf.base, buf.len, position, NULL);
     if (err < 0) {
         req.result = err;
         return ThrowUVException(req);
@@ -466,7 +958,170 @@ void fs_read(const v8::FunctionCallbackInfo<v8::Value>& args) {
     assert(req.result >= 0);
 
     uv_fs_req_cleanup(&req);
-    args.GetReturnValue().Set(v8::Integer::New(req.result));
+    args.GetReturnValue().Set(v8::Number::New(static_cast<double>(req.result)));
+}
+
+// layout of the Float64Array filled by fs_stat, fs_fstat and fs_lstat
+// times are milliseconds since the epoch with sub-millisecond fractions
+enum StatField {
+    kStatDev,
+    kStatMode,
+    kStatNlink,
+    kStatUid,
+    kStatGid,
+    kStatRdev,
+    kStatIno,
+    kStatSize,
+    kStatBlksize,
+    kStatBlocks,
+    kStatAtime,
+    kStatMtime,
+    kStatCtime,
+    kStatBirthtime,
+    kStatLength
+};
+
+inline double StatTime(const uv_timespec_t& ts) {
+    return static_cast<double>(ts.tv_sec) * 1000 + static_cast<double>(ts.tv_nsec) / 1000000;
+}
+
+inline void FillStats(const uv_stat_t* s, double* fields) {
+    fields[kStatDev] = static_cast<double>(s->st_dev);
+    fields[kStatMode] = static_cast<double>(s->st_mode);
+    fields[kStatNlink] = static_cast<double>(s->st_nlink);
+    fields[kStatUid] = static_cast<double>(s->st_uid);
+    fields[kStatGid] = static_cast<double>(s->st_gid);
+    fields[kStatRdev] = static_cast<double>(s->st_rdev);
+    fields[kStatIno] = static_cast<double>(s->st_ino);
+    fields[kStatSize] = static_cast<double>(s->st_size);
+    fields[kStatBlksize] = static_cast<double>(s->st_blksize);
+    fields[kStatBlocks] = static_cast<double>(s->st_blocks);
+    fields[kStatAtime] = StatTime(s->st_atim);
+    fields[kStatMtime] = StatTime(s->st_mtim);
+    fields[kStatCtime] = StatTime(s->st_ctim);
+    fields[kStatBirthtime] = StatTime(s->st_birthtim);
+}
+
+// async stat, holds on to the array being filled until the request is done
+struct FsStatReq {
+    uv_fs_t req;
+    Callback cb;
+    double* fields;
+    v8::Persistent<v8::ArrayBuffer> buffer;
+
+    static void After_Stat(uv_fs_t* req) {
+        v8::Isolate* isolate = v8::Isolate::GetCurrent();
+        v8::HandleScope scope(isolate);
+
+        FsStatReq* stat = static_cast<FsStatReq*>(req->data);
+
+        const int argc = 1;
+        v8::Local<v8::Value> argv[argc];
+
+        if (req->result < 0) {
+            argv[0] = UVException(*req);
+        }
+        else {
+            FillStats(static_cast<const uv_stat_t*>(req->ptr), stat->fields);
+            argv[0] = Null(isolate);
+        }
+
+        stat->cb.Call(argc, argv);
+
+        uv_fs_req_cleanup(req);
+        stat->buffer.Reset();
+        delete stat;
+    }
+};
+
+enum StatKind {
+    kStat,
+    kLstat,
+    kFstat
+};
+
+// shared by fs_stat, fs_lstat and fs_fstat, args[1] is a path or an fd
+void FsStat(const v8::FunctionCallbackInfo<v8::Value>& args, StatKind kind) {
+    assert(args.Length() == 4);
+    assert(kind == kFstat ? args[1]->IsInt32() : args[1]->IsString());
+    assert(args[2]->IsFloat64Array());
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+    v8::String::Utf8Value path(args[1]);
+    const int fd = args[1]->Int32Value();
+
+    uv_buf_t buf;
+    v8::Local<v8::ArrayBuffer> ab = BufferContents(args[2], &buf);
+    assert(buf.len >= kStatLength * sizeof(double));
+    double* fields = reinterpret_cast<double*>(buf.base);
+
+    uv_fs_t sync_req;
+    uv_fs_t* req = &sync_req;
+    uv_fs_cb cb = NULL;
+
+    // async
+    FsStatReq* stat = NULL;
+    if (args[3]->IsFunction()) {
+        stat = new FsStatReq;
+        stat->req.data = stat;
+        stat->cb.Reset(args[3]);
+        stat->fields = fields;
+        stat->buffer.Reset(args.GetIsolate(), ab);
+
+        req = &stat->req;
+        cb = FsStatReq::After_Stat;
+    }
+
+    int err = 0;
+    switch (kind) {
+        case kStat: err = uv_fs_stat(loop, req, *path, cb); break;
+        case kLstat: err = uv_fs_lstat(loop, req, *path, cb); break;
+        case kFstat: err = uv_fs_fstat(loop, req, fd, cb); break;
+    }
+
+    if (stat) {
+        if (err < 0) {
+            stat->req.result = err;
+            stat->req.path = NULL;
+            FsStatReq::After_Stat(&stat->req);
+        }
+
+        args.GetReturnValue().Set(v8::Integer::New(err));
+        return;
+    }
+
+    // SYNC
+    if (err < 0) {
+        sync_req.result = err;
+        return ThrowUVException(sync_req);
+    }
+
+    FillStats(static_cast<const uv_stat_t*>(sync_req.ptr), fields);
+    uv_fs_req_cleanup(&sync_req);
+
+    args.GetReturnValue().Set(v8::Integer::New(0));
+}
+
+// fs_stat(loop, path, stats, cb)
+// fs_lstat(loop, path, stats, cb)
+// fs_fstat(loop, fd, stats, cb)
+//
+// fill stats, a Float64Array of at least UVJS_STAT_LENGTH, indexed by UVJS_STAT_*
+// no object is built per call so one array can be reused for every stat
+// returns 0 when cb is null, otherwise cb(err) once stats is filled
+void fs_stat(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    FsStat(args, kStat);
+}
+
+void fs_lstat(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    FsStat(args, kLstat);
+}
+
+void fs_fstat(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    FsStat(args, kFstat);
 }
 
 } // namespace detail
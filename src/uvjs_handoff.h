@@ -0,0 +1,387 @@
+#pragma once
+
+#include <assert.h>
+#include <v8.h>
+#include <uv.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "handle_wrap.h"
+#include "uvjs_tcp.h"
+#include "callback.h"
+#include "unwrap.h"
+#include "throw.h"
+#include "templates.h"
+#include "statics.h"
+
+namespace uvjs {
+namespace detail {
+
+// connection handoff between loops
+//
+// an acceptor loop accepts connections and hands the sockets to worker loops
+// (usually running on worker threads, see uvjs_worker.h). Workers register a
+// handoff target under a group name, the acceptor picks a target from the group
+// for each connection either round robin or by least load.
+//
+// sockets travel as file descriptors through a native queue on the target,
+// a uv_async_t wakes the target loop which adopts all queued sockets at once.
+// processes can't share fds this way, that needs uv_write2 over a pipe which
+// uvjs does not bind yet.
+
+enum HandoffMode {
+    kHandoffRoundRobin,
+    kHandoffLeastLoad
+};
+
+class HandoffTarget;
+
+// connections a target owns, queued or open
+// outlives the target while any of its connections are still open
+struct HandoffLoad {
+    HandoffLoad() : connections(0), refs(1) {}
+
+    size_t connections;
+    size_t refs;
+};
+
+// all targets registered under one name
+struct HandoffGroup {
+    HandoffGroup() : next(0) {}
+
+    std::vector<HandoffTarget*> targets;
+    size_t next;
+};
+
+// process wide registry of handoff groups
+// targets and acceptors run on different threads, everything below is
+// only touched with the registry lock held
+class HandoffRegistry : public StaticMutex<HandoffRegistry> {
+public:
+    // group for name, created on first use and never freed
+    static HandoffGroup* Group(const std::string& name) {
+        HandoffGroup*& group = _groups[name];
+        if (!group) {
+            group = new HandoffGroup();
+        }
+
+        return group;
+    }
+
+    // drop a reference on load, freed once the target and its connections are gone
+    static void Release(HandoffLoad* load, bool connection) {
+        Lock();
+
+        if (connection) {
+            assert(load->connections > 0);
+            --load->connections;
+        }
+
+        const bool last = --load->refs == 0;
+        Unlock();
+
+        if (last) {
+            delete load;
+        }
+    }
+
+private:
+    static std::map<std::string, HandoffGroup*> _groups;
+};
+
+std::map<std::string, HandoffGroup*> HandoffRegistry::_groups;
+
+// HandoffTarget receives sockets accepted on other loops
+class HandoffTarget : public HandleWrap<uv_async_t> {
+public:
+    HandoffTarget(const std::string& group)
+        : HandleWrap<uv_async_t>(), _group(group), _load(new HandoffLoad()) {}
+
+    ~HandoffTarget() {
+        HandoffRegistry::Release(_load, false);
+    }
+
+    int init(uv_loop_t* loop) {
+        const int err = uv_async_init(loop, _handle, After_Async);
+        if (err) {
+            return err;
+        }
+
+        HandoffRegistry::Lock();
+        HandoffRegistry::Group(_group)->targets.push_back(this);
+        HandoffRegistry::Unlock();
+
+        return 0;
+    }
+
+    Callback& callback() {
+        return _cb;
+    }
+
+    // stop receiving connections, sockets still queued are closed
+    void leave() {
+        std::vector<uv_os_sock_t> queue;
+
+        HandoffRegistry::Lock();
+
+        std::vector<HandoffTarget*>& targets = HandoffRegistry::Group(_group)->targets;
+        targets.erase(std::remove(targets.begin(), targets.end(), this), targets.end());
+
+        queue.swap(_queue);
+        _load->connections -= queue.size();
+
+        HandoffRegistry::Unlock();
+
+        for (size_t i = 0 ; i < queue.size() ; ++i) {
+            ::close(queue[i]);
+        }
+    }
+
+    // pick a target in group, NULL if the group has no targets
+    // call with the registry lock held, the target stays in the group until
+    // the lock is released
+    static HandoffTarget* Pick(const std::string& name, HandoffMode mode) {
+        HandoffGroup* group = HandoffRegistry::Group(name);
+        if (group->targets.empty()) {
+            return 0;
+        }
+
+        if (mode == kHandoffRoundRobin) {
+            return group->targets[group->next++ % group->targets.size()];
+        }
+
+        HandoffTarget* target = group->targets[0];
+        for (size_t i = 1 ; i < group->targets.size() ; ++i) {
+            if (group->targets[i]->_load->connections < target->_load->connections) {
+                target = group->targets[i];
+            }
+        }
+
+        return target;
+    }
+
+    // queue fd for our loop, call with the registry lock held
+    // fd is not consumed on error
+    int Send(uv_os_sock_t fd) {
+        // under the lock, a target only closes its async after leaving the group
+        // and the wakeup can't see the queue before fd is on it
+        const int err = uv_async_send(_handle);
+        if (err) {
+            return err;
+        }
+
+        _queue.push_back(fd);
+        ++_load->connections;
+        return 0;
+    }
+
+private:
+    // adopt every queued socket into a tcp handle on our loop
+    static void After_Async(uv_async_t* handle, int status) {
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+
+        HandoffTarget* target = static_cast<HandoffTarget*>(handle->data);
+
+        std::vector<uv_os_sock_t> queue;
+
+        HandoffRegistry::Lock();
+        queue.swap(target->_queue);
+        target->_load->refs += queue.size();
+        HandoffRegistry::Unlock();
+
+        v8::Local<v8::Array> clients = v8::Array::New();
+        v8::Local<v8::ObjectTemplate> tmpl = Templates::Get(kTcpTemplate);
+
+        for (size_t i = 0 ; i < queue.size() ; ++i) {
+            TcpWrap* client = new TcpWrap();
+
+            int err = client->init(handle->loop);
+            if (err) {
+                delete client;
+            }
+            else {
+                err = uv_tcp_open(client->tcp(), queue[i]);
+
+                // the handle is on the loop already
+                if (err) {
+                    client->discard();
+                }
+            }
+
+            if (err) {
+                ::close(queue[i]);
+                HandoffRegistry::Release(target->_load, true);
+                status = err;
+                continue;
+            }
+
+            client->set_handoff_load(target->_load);
+
+            v8::Local<v8::Object> instance = tmpl->NewInstance();
+            client->Wrap(instance);
+            clients->Set(clients->Length(), instance);
+        }
+
+        const int argc = 2;
+        v8::Local<v8::Value> argv[argc] = { v8::Integer::New(status), clients };
+        target->callback().Call(argc, argv);
+    }
+
+    std::string _group;
+
+    // sockets waiting for our loop
+    std::vector<uv_os_sock_t> _queue;
+    HandoffLoad* _load;
+
+    Callback _cb;
+};
+
+void TcpWrap::Closed() {
+    StreamWrap<uv_tcp_t>::Closed();
+
+    if (_handoff_load) {
+        HandoffRegistry::Release(_handoff_load, true);
+        _handoff_load = 0;
+    }
+}
+
+// handoff(group, mode)
+//
+// accept a pending connection and hand it to a target in group
+// use instead of accept() in the listen callback. Returns UV_ENOENT while the
+// group has no targets, the connection stays pending and can be handed off
+// (or accepted) later
+void TcpWrap::Tcp_Handoff(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() >= 1);
+    assert(args[0]->IsString());
+
+    TcpWrap* wrap = Unwrap<TcpWrap>(args.This());
+
+    const std::string group = *v8::String::Utf8Value(args[0]);
+    const HandoffMode mode = args[1]->Int32Value() == kHandoffLeastLoad ?
+        kHandoffLeastLoad : kHandoffRoundRobin;
+
+#if defined(_WIN32)
+    args.GetReturnValue().Set(v8::Integer::New(UV_ENOTSUP));
+#else
+    // accept on our loop, then move a duplicate of the fd to the target
+    // the temporary handle closes the original
+    uv_tcp_t* client = new uv_tcp_t();
+
+    int err = uv_tcp_init(wrap->_handle->loop, client);
+    if (err) {
+        delete client;
+        args.GetReturnValue().Set(v8::Integer::New(err));
+        return;
+    }
+
+    // nobody to take it, leave the connection pending on the listener
+    HandoffRegistry::Lock();
+
+    HandoffTarget* target = HandoffTarget::Pick(group, mode);
+    if (!target) {
+        err = UV_ENOENT;
+    }
+
+    if (!err) {
+        err = uv_accept(reinterpret_cast<uv_stream_t*>(wrap->_handle),
+                reinterpret_cast<uv_stream_t*>(client));
+    }
+
+    uv_os_fd_t fd = -1;
+    if (!err) {
+        err = uv_fileno(reinterpret_cast<uv_handle_t*>(client), &fd);
+    }
+
+    if (!err) {
+        fd = dup(fd);
+        err = fd < 0 ? -errno : 0;
+    }
+
+    if (!err) {
+        err = target->Send(fd);
+        if (err) {
+            ::close(fd);
+        }
+    }
+
+    HandoffRegistry::Unlock();
+
+    uv_close(reinterpret_cast<uv_handle_t*>(client), After_Handoff_Close);
+    args.GetReturnValue().Set(v8::Integer::New(err));
+#endif
+}
+
+void TcpWrap::After_Handoff_Close(uv_handle_t* handle) {
+    delete reinterpret_cast<uv_tcp_t*>(handle);
+}
+
+void Handoff_Close(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 1);
+    assert(args[0]->IsFunction());
+
+    HandoffTarget* target = Unwrap<HandoffTarget>(args.This());
+
+    // leave the group before closing so no acceptor signals a closing handle
+    target->leave();
+
+    target->close_callback().Reset(args[0]);
+    target->close();
+}
+
+// template for handoff targets, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> HandoffTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    obj->Set(v8::String::NewSymbol("close"), v8::FunctionTemplate::New(Handoff_Close));
+
+    return handle_scope.Close(obj);
+}
+
+// handoff_init(loop, group, cb) -> cb(status, [client, ...])
+//
+// receive connections handed off to group on loop
+// the target keeps the loop alive until it is closed
+void handoff_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 3);
+    assert(args[1]->IsString());
+    assert(args[2]->IsFunction());
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+
+    HandoffTarget* target = new HandoffTarget(*v8::String::Utf8Value(args[1]));
+
+    const int err = target->init(loop);
+    if (err) {
+        delete target;
+        return UVThrow(err);
+    }
+
+    v8::Local<v8::Object> instance = Templates::Get(kHandoffTemplate)->NewInstance();
+    target->Wrap(instance);
+    target->callback().Reset(args[2]);
+
+    // live for the callback until closed
+    target->Ref();
+
+    args.GetReturnValue().Set(instance);
+}
+
+} // namespace detail
+} // namespace uvjs
@@ -3,11 +3,80 @@
 #include <assert.h>
 #include <uv.h>
 
+#include <map>
+
 #include "unwrap.h"
+#include "slab_allocator.h"
+#include "stream_wrap.h"
+#include "uvjs_tcp.h"
+#include "loop_data.h"
+#include "loop_metrics.h"
+#include "loop_watchdog.h"
+#include "templates.h"
+#include "handle_type.h"
+#include "handle_wrap.h"
+#include "statics.h"
 
 namespace uvjs {
 namespace detail {
 
+// release the native state attached to a loop which is going away
+//
+// when run is set the loop is run once more so our hook handles finish closing
+// and their memory can be released, otherwise that memory is leaked
+void DisposeLoopData(uv_loop_t* loop, bool run) {
+    LoopData* data = static_cast<LoopData*>(loop->data);
+    if (!data) {
+        return;
+    }
+
+    if (data->slab) {
+        data->slab->Close();
+    }
+
+    // the thread must not touch the loop past this point, even if we leak
+    if (data->watchdog) {
+        data->watchdog->Stop();
+    }
+
+    if (run) {
+        if (data->cork_flusher) {
+            data->cork_flusher->Close();
+        }
+
+        if (data->accept_batcher) {
+            data->accept_batcher->Close();
+        }
+
+        if (data->metrics) {
+            data->metrics->Close();
+        }
+
+        uv_run(loop, UV_RUN_NOWAIT);
+
+        delete data->cork_flusher;
+        delete data->accept_batcher;
+        delete data->metrics;
+    }
+
+    delete data;
+    loop->data = NULL;
+}
+
+// the loop default_loop() returns on this thread
+// worker threads each run their own loop, see uvjs_worker.h
+class ThreadLoop {
+public:
+    static uv_loop_t* Get() {
+        uv_loop_t* loop = ThreadLocal<uv_loop_t, ThreadLoop>::Get();
+        return loop ? loop : uv_default_loop();
+    }
+
+    static void Set(uv_loop_t* loop) {
+        ThreadLocal<uv_loop_t, ThreadLoop>::Set(loop);
+    }
+};
+
 // cleanup a uv_loop_t* created in loop_new
 // we don't use object_wrap to be leaner
 static void WeakUvLoop(v8::Isolate* isolate, v8::Persistent<v8::Object>* persistent,
@@ -24,18 +93,27 @@ static void WeakUvLoop(v8::Isolate* isolate, v8::Persistent<v8::Object>* persist
     persistent->ClearWeak();
     persistent->Dispose();
 
+    // running the loop here could call into js during gc
+    DisposeLoopData(loop, false);
     uv_loop_delete(loop);
 }
 
+// template for loop objects, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> LoopTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    return handle_scope.Close(obj);
+}
+
 void loop_new(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
     uv_loop_t* new_loop = uv_loop_new();
 
-    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
-    obj->SetInternalFieldCount(1);
-
-    v8::Local<v8::Object> instance = obj->NewInstance();
+    v8::Local<v8::Object> instance = Templates::Get(kLoopTemplate)->NewInstance();
     instance->SetAlignedPointerInInternalField(0, new_loop);
 
     v8::Persistent<v8::Object> persistent;
@@ -49,11 +127,8 @@ void loop_new(const v8::FunctionCallbackInfo<v8::Value>& args) {
 void default_loop(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
-    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
-    obj->SetInternalFieldCount(1);
-
-    v8::Local<v8::Object> obj_inst = obj->NewInstance();
-    obj_inst->SetAlignedPointerInInternalField(0, uv_default_loop());
+    v8::Local<v8::Object> obj_inst = Templates::Get(kLoopTemplate)->NewInstance();
+    obj_inst->SetAlignedPointerInInternalField(0, ThreadLoop::Get());
 
     args.GetReturnValue().Set(obj_inst);
 }
@@ -96,6 +171,115 @@ void backend_timeout(const v8::FunctionCallbackInfo<v8::Value>& args) {
     args.GetReturnValue().Set(v8::Integer::New(timeout));
 }
 
+// metrics_start(loop) -> Float64Array
+//
+// record where the loop spends its time, see loop_metrics.h for the layout
+// the returned array is live, it is updated as the loop runs
+void metrics_start(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    assert(args.Length() == 1);
+
+    LoopMetrics* metrics = LoopMetrics::ForLoop(Unwrap<uv_loop_t>(args[0]));
+    metrics->Start();
+
+    args.GetReturnValue().Set(metrics->snapshot());
+}
+
+void metrics_stop(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    assert(args.Length() == 1);
+
+    LoopData* data = LoopData::Get(Unwrap<uv_loop_t>(args[0]));
+    if (data->metrics) {
+        data->metrics->Stop();
+    }
+}
+
+struct WalkState {
+    std::map<uv_handle_t*, HandleBase*> wraps;
+    v8::Local<v8::Array> handles;
+};
+
+void WalkHandle(uv_handle_t* handle, void* arg) {
+    WalkState* state = static_cast<WalkState*>(arg);
+
+    v8::Local<v8::Object> info = v8::Object::New();
+    info->Set(v8::String::NewSymbol("type"), v8::String::New(HandleTypeName(handle->type)));
+    info->Set(v8::String::NewSymbol("active"), v8::Boolean::New(uv_is_active(handle) != 0));
+    info->Set(v8::String::NewSymbol("ref"), v8::Boolean::New(uv_has_ref(handle) != 0));
+    info->Set(v8::String::NewSymbol("closing"), v8::Boolean::New(uv_is_closing(handle) != 0));
+
+    std::map<uv_handle_t*, HandleBase*>::iterator it = state->wraps.find(handle);
+    if (it != state->wraps.end()) {
+        it->second->Describe(info);
+    }
+
+    state->handles->Set(state->handles->Length(), info);
+}
+
+// watchdog_start(loop, ms, cb) -> cb(report)
+//
+// report a loop which made no progress for ms milliseconds, see loop_watchdog.h
+// the report is written to stderr while the loop is stuck, cb gets it afterwards
+void watchdog_start(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 3);
+    assert(args[1]->IsUint32());
+    assert(args[2]->IsFunction());
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+    assert(!LoopWatchdog::ForLoop(loop));
+
+    LoopWatchdog* watchdog = new LoopWatchdog(loop, args[1]->Uint32Value());
+    watchdog->callback().Reset(args[2]);
+
+    const int err = watchdog->Start();
+    if (err) {
+        delete watchdog;
+    }
+
+    args.GetReturnValue().Set(v8::Integer::New(err));
+}
+
+void watchdog_stop(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    assert(args.Length() == 1);
+
+    LoopWatchdog* watchdog = LoopWatchdog::ForLoop(Unwrap<uv_loop_t>(args[0]));
+    if (watchdog) {
+        watchdog->Stop();
+    }
+}
+
+// walk(loop) -> [{ type, active, ref, closing, ... }, ...]
+//
+// one entry per handle on the loop, closing handles included. Handles owned by
+// a js object also report what they hold on to:
+//  refs, weak: the reference count keeping the object alive, weak once it is 0
+//  close_cb, read_cb, listen_cb: callback slots which are set
+//  bytes_read, bytes_written, write_queue_size, writes_pending, reading: streams only
+// handles without an entry of their own are internal (loop hooks, timers of streams)
+void walk(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    assert(args.Length() == 1);
+
+    uv_loop_t* loop = Unwrap<uv_loop_t>(args[0]);
+
+    WalkState state;
+    state.handles = v8::Array::New();
+
+    for (HandleBase* wrap = HandleBase::First() ; wrap ; wrap = wrap->next()) {
+        if (wrap->uv_handle() && wrap->uv_handle()->loop == loop) {
+            state.wraps[wrap->uv_handle()] = wrap;
+        }
+    }
+
+    uv_walk(loop, WalkHandle, &state);
+
+    args.GetReturnValue().Set(state.handles);
+}
+
 void now(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
     assert(args.Length() == 1);
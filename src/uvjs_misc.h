@@ -34,5 +34,12 @@ void err_name(const v8::FunctionCallbackInfo<v8::Value>& args) {
     args.GetReturnValue().Set(v8::String::New(uv_err_name(args[0]->Int32Value())));
 }
 
+// hrtime() -> nanoseconds from an arbitrary point in the past
+// as a double, precise to the nanosecond for over 100 days of uptime
+void hrtime(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+    args.GetReturnValue().Set(v8::Number::New(static_cast<double>(uv_hrtime())));
+}
+
 } // namespace detail
 } // namespace uvjs
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <v8.h>
+#include <uv.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "buffer.h"
+#include "internal.h"
+#include "mapped_files.h"
+#include "uvjs_fs.h"
+
+namespace uvjs {
+namespace detail {
+
+// file mappings as ArrayBuffers
+//
+// read mappings are private (copy on write), the file never changes but js
+// can still write to the buffer without faulting. Shared mappings write
+// through to the file and need an fd opened for reading and writing.
+//
+// the mapping goes away when the buffer is collected or with fs_munmap.
+// touching a mapped page past the end of a file truncated after mapping
+// raises SIGBUS, only map files which do not shrink. Not available on
+// windows, fs_mmap and friends are left out of the bindings there.
+enum MmapMode {
+    kMmapRead,
+    kMmapShared
+};
+
+enum MmapAdvice {
+    kAdviceNormal,
+    kAdviceSequential,
+    kAdviceRandom,
+    kAdviceWillNeed,
+    kAdviceDontNeed
+};
+
+#if !defined(_WIN32)
+
+// map length bytes of fd from position, data is where position landed
+inline int MapFile(uv_file fd, int64_t position, size_t length, MmapMode mode, void** data) {
+    const int64_t page = sysconf(_SC_PAGESIZE);
+    const int64_t aligned = position - position % page;
+    const size_t delta = static_cast<size_t>(position - aligned);
+
+    const int flags = mode == kMmapShared ? MAP_SHARED : MAP_PRIVATE;
+
+    void* base = mmap(NULL, length + delta, PROT_READ | PROT_WRITE, flags, fd, aligned);
+    if (base == MAP_FAILED) {
+        return -errno;
+    }
+
+    Mapping mapping = { base, length + delta };
+    *data = static_cast<char*>(base) + delta;
+
+    MappedFiles::Add(*data, mapping);
+    return 0;
+}
+
+// ArrayBufferAllocator::ReleaseCallback of mapped buffers
+inline void Unmap(void* data, size_t bytes) {
+    Mapping mapping;
+    if (MappedFiles::Remove(data, &mapping)) {
+        munmap(mapping.base, mapping.len);
+    }
+}
+
+inline int Advise(void* data, MmapAdvice advice) {
+    Mapping mapping;
+    if (!MappedFiles::Find(data, &mapping)) {
+        return UV_EINVAL;
+    }
+
+    int madv = MADV_NORMAL;
+    switch (advice) {
+        case kAdviceNormal: madv = MADV_NORMAL; break;
+        case kAdviceSequential: madv = MADV_SEQUENTIAL; break;
+        case kAdviceRandom: madv = MADV_RANDOM; break;
+        case kAdviceWillNeed: madv = MADV_WILLNEED; break;
+        case kAdviceDontNeed: madv = MADV_DONTNEED; break;
+        default: return UV_EINVAL;
+    }
+
+    return madvise(mapping.base, mapping.len, madv) < 0 ? -errno : 0;
+}
+
+inline int FileSize(uv_file fd, int64_t* size) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return -errno;
+    }
+
+    *size = st.st_size;
+    return 0;
+}
+
+// fs_mmap(fd, position, length, mode) -> ArrayBuffer
+// fs_mmap(fd, position, length, mode, advice) -> ArrayBuffer
+//
+// map length bytes of the file from position (null for 0) as an ArrayBuffer
+// a null length maps the rest of the file. mode is UVJS_MMAP_READ or
+// UVJS_MMAP_SHARED, advice one of UVJS_MADV_*. Throws on failure.
+void fs_mmap(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 4 || args.Length() == 5);
+    assert(args[0]->IsInt32());
+    assert(args[3]->IsInt32());
+
+    const uv_file fd = args[0]->Int32Value();
+    const MmapMode mode = static_cast<MmapMode>(args[3]->Int32Value());
+    assert(mode == kMmapRead || mode == kMmapShared);
+
+    int64_t position = FilePosition(args[1]);
+    if (position < 0) {
+        position = 0;
+    }
+
+    int64_t length = FilePosition(args[2]);
+    if (length < 0) {
+        int64_t size = 0;
+        const int err = FileSize(fd, &size);
+        if (err < 0) {
+            v8::ThrowException(UVException(err, NULL));
+            return;
+        }
+
+        length = size > position ? size - position : 0;
+    }
+
+    // nothing to map
+    if (length == 0) {
+        args.GetReturnValue().Set(v8::ArrayBuffer::New(0));
+        return;
+    }
+
+    void* data;
+    const int err = MapFile(fd, position, static_cast<size_t>(length), mode, &data);
+    if (err < 0) {
+        v8::ThrowException(UVException(err, NULL));
+        return;
+    }
+
+    if (args.Length() == 5) {
+        assert(args[4]->IsInt32());
+        Advise(data, static_cast<MmapAdvice>(args[4]->Int32Value()));
+    }
+
+    args.GetReturnValue().Set(uvjs::detail::allocator->Externalize(data,
+            static_cast<size_t>(length), Unmap));
+}
+
+// fs_munmap(buffer) -> err
+//
+// unmap a buffer from fs_mmap now instead of when it is collected
+// the buffer is neutered (zero length) afterwards. UV_EBUSY while a pending
+// write or read still uses it, UV_EINVAL if it is not a mapping
+void fs_munmap(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 1);
+    assert(args[0]->IsArrayBuffer());
+
+    v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(args[0]);
+
+    // never externalized, can't be one of ours
+    Mapping mapping;
+    if (!ab->IsExternal() ||
+            !MappedFiles::Find(uvjs::detail::allocator->Externalized(ab), &mapping)) {
+        args.GetReturnValue().Set(v8::Integer::New(UV_EINVAL));
+        return;
+    }
+
+    // libuv or the threadpool still reads from or writes to the pages
+    if (uvjs::detail::allocator->Pinned(ab)) {
+        args.GetReturnValue().Set(v8::Integer::New(UV_EBUSY));
+        return;
+    }
+
+    // the allocator no longer unmaps it once collected
+    const size_t bytes = ab->ByteLength();
+    void* data = uvjs::detail::allocator->Release(ab);
+    ab->Neuter();
+
+    Unmap(data, bytes);
+    args.GetReturnValue().Set(v8::Integer::New(0));
+}
+
+// fs_madvise(buffer, advice) -> err
+void fs_madvise(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[0]->IsArrayBuffer());
+    assert(args[1]->IsInt32());
+
+    v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(args[0]);
+    if (!ab->IsExternal()) {
+        args.GetReturnValue().Set(v8::Integer::New(UV_EINVAL));
+        return;
+    }
+
+    const int err = Advise(uvjs::detail::allocator->Externalized(ab),
+            static_cast<MmapAdvice>(args[1]->Int32Value()));
+    args.GetReturnValue().Set(v8::Integer::New(err));
+}
+
+#endif
+
+} // namespace detail
+} // namespace uvjs
@@ -1,28 +1,80 @@
 #pragma once
 
 #include <assert.h>
+#include <errno.h>
 #include <v8.h>
 #include <uv.h>
 
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+
 #include "stream_wrap.h"
 #include "unwrap.h"
 #include "throw.h"
+#include "templates.h"
+#include "loop_data.h"
 
 namespace uvjs {
 namespace detail {
 
+struct HandoffLoad;
+
 class TcpWrap : public StreamWrap<uv_tcp_t> {
 public:
-    TcpWrap() : StreamWrap<uv_tcp_t>() {}
+    TcpWrap() : StreamWrap<uv_tcp_t>(), _accept_status(0), _handoff_load(0) {}
+
+    uv_tcp_t* tcp() {
+        return _handle;
+    }
 
     int init(uv_loop_t* loop) {
         return uv_tcp_init(loop, _handle);
     }
 
+    // free a wrap which was initialized but never got a js object
+    // init linked the handle into the loop, it has to be closed before deleting
+    void discard() {
+        uv_close(reinterpret_cast<uv_handle_t*>(_handle), After_death_close);
+    }
+
     int bind(const struct sockaddr* addr) {
         return uv_tcp_bind(_handle, addr);
     }
 
+    // bind with SO_REUSEPORT so listeners on several loops (threads)
+    // can share the port and the kernel spreads connections between them
+    // libuv creates its socket lazily in bind, so we open our own first
+    int bind_reuseport(const struct sockaddr* addr) {
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+        const int fd = socket(addr->sa_family, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -errno;
+        }
+
+        const int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+            const int err = -errno;
+            ::close(fd);
+            return err;
+        }
+
+        const int err = uv_tcp_open(_handle, fd);
+        if (err) {
+            ::close(fd);
+            return err;
+        }
+
+        return uv_tcp_bind(_handle, addr);
+#else
+        return UV_ENOTSUP;
+#endif
+    }
+
     // TODO get socket name
     // return socket struct wrapper/object access
     int getsockname() {
@@ -59,7 +111,29 @@ public:
         return _connect_cb;
     }
 
+    // listen and accept every pending connection natively
+    // accepted clients are handed to js in one batch per loop iteration
+    int listen_all(int backlog) {
+        this->Ref();
+        return uv_listen(reinterpret_cast<uv_stream_t*>(_handle), backlog, After_Listen_All);
+    }
+
+    // deliver the batch of accepted clients to the listen callback
+    void flush_accepted();
+
+    // this client was handed off from another loop, see uvjs_handoff.h
+    // the load is released once the client is closed
+    void set_handoff_load(HandoffLoad* load) {
+        _handoff_load = load;
+    }
+
+    void Closed();
+
     static void Tcp_Accept(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Tcp_Listen_All(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void After_Listen_All(uv_stream_t* server, int status);
+    static void Tcp_Handoff(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void After_Handoff_Close(uv_handle_t* handle);
 
     static void After_Connect(uv_connect_t* req, int status) {
         v8::HandleScope scope(v8::Isolate::GetCurrent());
@@ -75,8 +149,145 @@ public:
 
 private:
     Callback _connect_cb;
+
+    // clients accepted since the last flush, see listen_all
+    std::vector<TcpWrap*> _accepted;
+    int _accept_status;
+
+    HandoffLoad* _handoff_load;
+};
+
+// AcceptBatcher delivers natively accepted clients once per loop iteration
+//
+// libuv calls the connection callback once per connection while it drains
+// the listen backlog during poll, the check hook runs right after poll so
+// every connection from that burst ends up in a single js callback.
+class AcceptBatcher {
+public:
+    AcceptBatcher(uv_loop_t* loop) {
+        uv_check_init(loop, &_check);
+        _check.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_check));
+    }
+
+    static AcceptBatcher* ForLoop(uv_loop_t* loop) {
+        LoopData* data = LoopData::Get(loop);
+        if (!data->accept_batcher) {
+            data->accept_batcher = new AcceptBatcher(loop);
+        }
+
+        return data->accept_batcher;
+    }
+
+    // release the hook, the loop must run once more before we are deleted
+    void Close() {
+        uv_close(reinterpret_cast<uv_handle_t*>(&_check), NULL);
+    }
+
+    // server has accepted clients waiting for js
+    void Schedule(TcpWrap* server) {
+        if (_pending.empty()) {
+            uv_check_start(&_check, After_Check);
+        }
+
+        _pending.push_back(server);
+    }
+
+private:
+    static void After_Check(uv_check_t* handle, int status) {
+        AcceptBatcher* batcher = static_cast<AcceptBatcher*>(handle->data);
+        uv_check_stop(&batcher->_check);
+
+        std::vector<TcpWrap*> pending;
+        pending.swap(batcher->_pending);
+
+        for (size_t i = 0 ; i < pending.size() ; ++i) {
+            pending[i]->flush_accepted();
+        }
+    }
+
+    uv_check_t _check;
+    std::vector<TcpWrap*> _pending;
 };
 
+void TcpWrap::After_Listen_All(uv_stream_t* server, int status) {
+    assert(server->data);
+    TcpWrap* wrap = static_cast<TcpWrap*>(server->data);
+
+    // first connection of this iteration, stay alive until delivered
+    if (wrap->_accepted.empty() && !wrap->_accept_status) {
+        wrap->Ref();
+        AcceptBatcher::ForLoop(server->loop)->Schedule(wrap);
+    }
+
+    if (status) {
+        wrap->_accept_status = status;
+        return;
+    }
+
+    TcpWrap* client = new TcpWrap();
+
+    int err = client->init(server->loop);
+    if (err) {
+        delete client;
+        wrap->_accept_status = err;
+        return;
+    }
+
+    // EMFILE and friends, the client handle is already on the loop
+    err = wrap->accept(client);
+    if (err) {
+        client->discard();
+        wrap->_accept_status = err;
+        return;
+    }
+
+    wrap->_accepted.push_back(client);
+}
+
+void TcpWrap::flush_accepted() {
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope scope(isolate);
+
+    v8::Local<v8::Array> clients = v8::Array::New(_accepted.size());
+    v8::Local<v8::ObjectTemplate> tmpl = Templates::Get(kTcpTemplate);
+
+    for (size_t i = 0 ; i < _accepted.size() ; ++i) {
+        v8::Local<v8::Object> instance = tmpl->NewInstance();
+        _accepted[i]->Wrap(instance);
+        clients->Set(i, instance);
+    }
+
+    const int status = _accept_status;
+
+    _accepted.clear();
+    _accept_status = 0;
+
+    if (!listen_callback().IsEmpty()) {
+        const int argc = 2;
+        v8::Local<v8::Value> argv[argc] = { v8::Integer::New(status), clients };
+        listen_callback().Call(argc, argv);
+    }
+
+    // delivered, release the reference taken in After_Listen_All
+    this->Unref();
+}
+
+// listen_all(backlog, cb) -> cb(status, [client, ...])
+void TcpWrap::Tcp_Listen_All(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[0]->IsInt32());
+    assert(args[1]->IsFunction());
+
+    TcpWrap* wrap = Unwrap<TcpWrap>(args.This());
+    wrap->listen_callback().Reset(args[1]);
+
+    const int err = wrap->listen_all(args[0]->Int32Value());
+    args.GetReturnValue().Set(v8::Integer::New(err));
+}
+
 void Tcp_Connect(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
@@ -121,6 +332,9 @@ void Tcp_Bind(const v8::FunctionCallbackInfo<v8::Value>& args) {
     // result addr struct
     struct sockaddr_in addr;
 
+    // { reuseport: true } lets listeners on several worker loops share the port
+    bool reuseport = false;
+
     // process object into sockaddr struct
     {
         // process
@@ -137,10 +351,14 @@ void Tcp_Bind(const v8::FunctionCallbackInfo<v8::Value>& args) {
         const int port = port_val->Int32Value();
 
         assert(uv_ip4_addr(ip, port, &addr) == 0);
+
+        reuseport = obj->Get(v8::String::NewSymbol("reuseport"))->BooleanValue();
     }
 
     TcpWrap* wrap = Unwrap<TcpWrap>(args.This());
-    const int err = wrap->bind(reinterpret_cast<sockaddr*>(&addr));
+    const int err = reuseport ?
+        wrap->bind_reuseport(reinterpret_cast<sockaddr*>(&addr)) :
+        wrap->bind(reinterpret_cast<sockaddr*>(&addr));
     args.GetReturnValue().Set(v8::Integer::New(err));
 }
 
@@ -161,7 +379,7 @@ void TcpWrap::Tcp_Accept(const v8::FunctionCallbackInfo<v8::Value>& args) {
     // new tcp wrapper for the client connect we accepted
     TcpWrap* client = new TcpWrap();
 
-    // TODO(shtylman) interesting, can we accept into a different loop?
+    // to accept into a loop on another thread use handoff(), see uvjs_handoff.h
     int err = client->init(wrap->_handle->loop);
     if (err) {
         delete client;
@@ -175,6 +393,18 @@ void TcpWrap::Tcp_Accept(const v8::FunctionCallbackInfo<v8::Value>& args) {
         return UVThrow(err);
     }
 
+    // accepted sockets share the tcp template with tcp_init handles
+    v8::Local<v8::Object> instance = Templates::Get(kTcpTemplate)->NewInstance();
+    client->Wrap(instance);
+
+    args.GetReturnValue().Set(instance);
+}
+
+
+// template for tcp handle objects, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> TcpTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
     v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
     obj->SetInternalFieldCount(1);
 
@@ -185,13 +415,14 @@ void TcpWrap::Tcp_Accept(const v8::FunctionCallbackInfo<v8::Value>& args) {
     obj->Set(v8::String::NewSymbol("bind"), v8::FunctionTemplate::New(Tcp_Bind));
     obj->Set(v8::String::NewSymbol("getsockname"), v8::FunctionTemplate::New(Tcp_Getsockname));
 
-    v8::Local<v8::Object> instance = obj->NewInstance();
-    client->Wrap(instance);
+    // technically a stream function, but we need to call uv_tcp_init on new handle
+    obj->Set(v8::String::NewSymbol("accept"), v8::FunctionTemplate::New(TcpWrap::Tcp_Accept));
+    obj->Set(v8::String::NewSymbol("listen_all"), v8::FunctionTemplate::New(TcpWrap::Tcp_Listen_All));
+    obj->Set(v8::String::NewSymbol("handoff"), v8::FunctionTemplate::New(TcpWrap::Tcp_Handoff));
 
-    args.GetReturnValue().Set(instance);
+    return handle_scope.Close(obj);
 }
 
-
 void tcp_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
@@ -207,20 +438,7 @@ void tcp_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
         return UVThrow(err);
     }
 
-    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
-    obj->SetInternalFieldCount(1);
-
-    TcpWrap::Mixin(obj);
-
-    // tcp stuff
-    obj->Set(v8::String::NewSymbol("connect"), v8::FunctionTemplate::New(Tcp_Connect));
-    obj->Set(v8::String::NewSymbol("bind"), v8::FunctionTemplate::New(Tcp_Bind));
-    obj->Set(v8::String::NewSymbol("getsockname"), v8::FunctionTemplate::New(Tcp_Getsockname));
-
-    // technically a stream function, but we need to call uv_tcp_init on new handle
-    obj->Set(v8::String::NewSymbol("accept"), v8::FunctionTemplate::New(TcpWrap::Tcp_Accept));
-
-    v8::Local<v8::Object> instance = obj->NewInstance();
+    v8::Local<v8::Object> instance = Templates::Get(kTcpTemplate)->NewInstance();
     wrap->Wrap(instance);
 
     args.GetReturnValue().Set(instance);
@@ -228,3 +446,6 @@ void tcp_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
 
 } // namespace detail
 } // namespace uvjs
+
+// TcpWrap::Closed and Tcp_Handoff live with the handoff registry
+#include "uvjs_handoff.h"
@@ -7,6 +7,8 @@
 #include "unwrap.h"
 #include "callback.h"
 #include "throw.h"
+#include "templates.h"
+#include "timer_wheel.h"
 
 namespace uvjs {
 namespace detail {
@@ -58,6 +60,7 @@ private:
 void After_timer(uv_timer_t* handle, int status) {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::HandleScope scope(isolate);
+    MetricsPhase phase(LoopMetrics::kPhaseTimer);
 
     assert(handle->data);
 
@@ -125,6 +128,26 @@ void Timer_Again(const v8::FunctionCallbackInfo<v8::Value>& args) {
     args.GetReturnValue().Set(v8::Integer::New(res));
 }
 
+// template for timer objects, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> TimerTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    // timer object container
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    // mixin handle features
+    TimerWrap::Mixin(obj);
+
+    obj->Set(v8::String::NewSymbol("stop"), v8::FunctionTemplate::New(Timer_Stop));
+    obj->Set(v8::String::NewSymbol("start"), v8::FunctionTemplate::New(Timer_Start));
+    obj->Set(v8::String::NewSymbol("again"), v8::FunctionTemplate::New(Timer_Again));
+    //obj->Set(v8::String::NewSymbol("set_repeat"), v8::FunctionTemplate::New(Timer_Set_Repeat));
+    //obj->Set(v8::String::NewSymbol("get_repeat"), v8::FunctionTemplate::New(Timer_Get_Repeat));
+
+    return handle_scope.Close(obj);
+}
+
 void timer_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
@@ -143,20 +166,7 @@ void timer_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
         return UVThrow(err);
     }
 
-    // timer object container
-    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
-    obj->SetInternalFieldCount(1);
-
-    // mixin handle features
-    TimerWrap::Mixin(obj);
-
-    obj->Set(v8::String::NewSymbol("stop"), v8::FunctionTemplate::New(Timer_Stop));
-    obj->Set(v8::String::NewSymbol("start"), v8::FunctionTemplate::New(Timer_Start));
-    obj->Set(v8::String::NewSymbol("again"), v8::FunctionTemplate::New(Timer_Again));
-    //obj->Set(v8::String::NewSymbol("set_repeat"), v8::FunctionTemplate::New(Timer_Set_Repeat));
-    //obj->Set(v8::String::NewSymbol("get_repeat"), v8::FunctionTemplate::New(Timer_Get_Repeat));
-
-    v8::Local<v8::Object> instance = obj->NewInstance();
+    v8::Local<v8::Object> instance = Templates::Get(kTimerTemplate)->NewInstance();
     wrap->Wrap(instance);
 
     args.GetReturnValue().Set(instance);
@@ -7,6 +7,7 @@
 #include "stream_wrap.h"
 #include "unwrap.h"
 #include "throw.h"
+#include "templates.h"
 
 namespace uvjs {
 namespace detail {
@@ -21,6 +22,23 @@ public:
 private:
 };
 
+// template for tty handle objects, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> TtyTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    TtyWrap::Mixin(obj);
+
+    // tty stuff
+    //obj->Set(v8::String::NewSymbol("set_mode"), v8::FunctionTemplate::New(Tcp_Connect));
+    //obj->Set(v8::String::NewSymbol("reset_mode"), v8::FunctionTemplate::New(Tcp_Bind));
+    //obj->Set(v8::String::NewSymbol("get_winsize"), v8::FunctionTemplate::New(Tcp_Getsockname));
+
+    return handle_scope.Close(obj);
+}
+
 void tty_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
 
@@ -41,17 +59,7 @@ void tty_init(const v8::FunctionCallbackInfo<v8::Value>& args) {
         return UVThrow(err);
     }
 
-    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
-    obj->SetInternalFieldCount(1);
-
-    TtyWrap::Mixin(obj);
-
-    // tty stuff
-    //obj->Set(v8::String::NewSymbol("set_mode"), v8::FunctionTemplate::New(Tcp_Connect));
-    //obj->Set(v8::String::NewSymbol("reset_mode"), v8::FunctionTemplate::New(Tcp_Bind));
-    //obj->Set(v8::String::NewSymbol("get_winsize"), v8::FunctionTemplate::New(Tcp_Getsockname));
-
-    v8::Local<v8::Object> instance = obj->NewInstance();
+    v8::Local<v8::Object> instance = Templates::Get(kTtyTemplate)->NewInstance();
     wrap->Wrap(instance);
 
     args.GetReturnValue().Set(instance);
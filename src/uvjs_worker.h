@@ -0,0 +1,217 @@
+#pragma once
+
+#include <assert.h>
+#include <stdio.h>
+#include <v8.h>
+#include <uv.h>
+
+#include <string>
+
+#include "uvjs.h"
+#include "uvjs_loop.h"
+#include "loop_data.h"
+#include "templates.h"
+#include "internal.h"
+#include "throw.h"
+
+namespace uvjs {
+namespace detail {
+
+// Worker runs a script on its own thread with its own isolate and loop
+//
+// nothing is shared with the spawning isolate, workers talk to the outside
+// world through the handles they create. A typical use is every worker binding
+// the same port with { reuseport: true } so the kernel spreads connections
+// over all the loops.
+//
+// the thread runs the script, then runs the worker loop until it has nothing
+// left to do. join() waits for that and returns 0 or 1 if the script threw.
+//
+// the js object stays alive until join() was called, a worker running a
+// server never finishes and joining it from the garbage collector would hang
+// the spawning isolate. Workers which are never joined are never freed.
+class Worker {
+public:
+    Worker(const char* source, const char* name, int id)
+        : _source(source), _name(name), _id(id), _status(0), _joined(false) {}
+
+    int start() {
+        return uv_thread_create(&_thread, Run, this);
+    }
+
+    int join() {
+        assert(!_joined);
+        _joined = true;
+
+        const int err = uv_thread_join(&_thread);
+        return err ? err : _status;
+    }
+
+    bool joined() const {
+        return _joined;
+    }
+
+    v8::Persistent<v8::Object>& persistent() {
+        return _obj_handle;
+    }
+
+    // free the worker once js forgets about it, only after join
+    void MakeWeak() {
+        assert(_joined);
+        _obj_handle.SetWeak(this, WeakCallback);
+        _obj_handle.MarkIndependent();
+    }
+
+private:
+    static void WeakCallback(const v8::WeakCallbackData<v8::Object, Worker>& data) {
+        Worker* worker = data.GetParameter();
+
+        worker->_obj_handle.ClearWeak();
+        worker->_obj_handle.Reset();
+
+        delete worker;
+    }
+
+    static void Run(void* arg) {
+        Worker* worker = static_cast<Worker*>(arg);
+
+        v8::Isolate* isolate = v8::Isolate::New();
+        uv_loop_t* loop = uv_loop_new();
+
+        // default_loop() in the worker isolate returns the worker loop
+        ThreadLoop::Set(loop);
+
+        {
+            v8::Locker locker(isolate);
+            v8::Isolate::Scope isolate_scope(isolate);
+            v8::HandleScope handle_scope(isolate);
+
+            v8::Handle<v8::Context> context = v8::Context::New(isolate, NULL,
+                    worker->Global());
+            v8::Context::Scope context_scope(context);
+
+            worker->_status = worker->Execute() ? 0 : 1;
+
+            if (!worker->_status) {
+                uv_run(loop, UV_RUN_DEFAULT);
+            }
+
+            DisposeLoopData(loop, true);
+        }
+
+        ThreadLoop::Set(NULL);
+        uv_loop_delete(loop);
+
+        isolate->Dispose();
+    }
+
+    // global object for the worker context
+    // the embedder can provide its own, it should expose uvjs::New()
+    v8::Handle<v8::ObjectTemplate> Global() {
+        v8::Handle<v8::ObjectTemplate> global;
+        if (uvjs::detail::worker_global) {
+            global = uvjs::detail::worker_global();
+        }
+        else {
+            global = v8::ObjectTemplate::New();
+            global->Set(v8::String::New("__uv_bindings"), uvjs::New());
+        }
+
+        global->Set(v8::String::New("__uv_worker_id"), v8::Integer::New(_id));
+        return global;
+    }
+
+    // run the worker script, exceptions are reported on stderr
+    bool Execute() {
+        v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+        v8::TryCatch try_catch;
+
+        v8::Handle<v8::Script> script = v8::Script::Compile(
+                v8::String::New(_source.c_str()), v8::String::New(_name.c_str()));
+
+        if (!script.IsEmpty()) {
+            script->Run();
+        }
+
+        if (try_catch.HasCaught()) {
+            v8::String::Utf8Value exception(try_catch.Exception());
+            fprintf(stderr, "%s: %s\n", _name.c_str(), *exception ? *exception : "<exception>");
+            return false;
+        }
+
+        return true;
+    }
+
+    uv_thread_t _thread;
+
+    std::string _source;
+    std::string _name;
+    int _id;
+
+    // written by the worker thread, read after join
+    int _status;
+    bool _joined;
+
+    v8::Persistent<v8::Object> _obj_handle;
+};
+
+void Worker_Join(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    Worker* worker = Unwrap<Worker>(args.This());
+    assert(!worker->joined());
+
+    const int status = worker->join();
+    worker->MakeWeak();
+
+    args.GetReturnValue().Set(v8::Integer::New(status));
+}
+
+// template for worker objects, built once per isolate by uvjs::New()
+v8::Handle<v8::ObjectTemplate> WorkerTemplate() {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+    v8::Handle<v8::ObjectTemplate> obj = v8::ObjectTemplate::New();
+    obj->SetInternalFieldCount(1);
+
+    obj->Set(v8::String::NewSymbol("join"), v8::FunctionTemplate::New(Worker_Join));
+
+    return handle_scope.Close(obj);
+}
+
+// worker_spawn(source, name)
+//
+// run source on a new thread with its own isolate and loop
+// returns a worker object, call join() to wait for the worker loop to finish
+void worker_spawn(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::HandleScope handle_scope(args.GetIsolate());
+
+    assert(args.Length() == 2);
+    assert(args[0]->IsString());
+    assert(args[1]->IsString());
+
+    // ids are only used to tell workers apart, they are never reused
+    static int next_id = 0;
+
+    v8::String::Utf8Value source(args[0]);
+    v8::String::Utf8Value name(args[1]);
+
+    Worker* worker = new Worker(*source, *name, ++next_id);
+
+    const int err = worker->start();
+    if (err) {
+        delete worker;
+        return UVThrow(err);
+    }
+
+    v8::Local<v8::Object> instance = Templates::Get(kWorkerTemplate)->NewInstance();
+    instance->SetAlignedPointerInInternalField(0, worker);
+
+    // strong until joined
+    worker->persistent().Reset(v8::Isolate::GetCurrent(), instance);
+
+    args.GetReturnValue().Set(instance);
+}
+
+} // namespace detail
+} // namespace uvjs
@@ -0,0 +1,147 @@
+var test = require('./support/test');
+var assert = require('./support/assert');
+var uv = require('./support/uv');
+
+test('batch', function(done) {
+    var async = uv.async_init(uv.default_loop(), function(messages) {
+        // sends before the loop wakes up are delivered together
+        assert(messages.length === 3);
+        messages.forEach(function(msg, i) {
+            assert(msg instanceof ArrayBuffer);
+            assert(new Uint8Array(msg)[0] === i);
+        });
+
+        async.close(function() {
+            done();
+        });
+    });
+
+    for (var i=0 ; i<3 ; ++i) {
+        assert(async.send(new Uint8Array([i])) === 0);
+    }
+});
+
+test('send from worker', function(done) {
+    var received = 0;
+
+    var async = uv.async_init(uv.default_loop(), function(messages) {
+        received += messages.length;
+        if (received < 100) {
+            return;
+        }
+
+        assert(received === 100);
+        async.close(function() {
+            assert(worker.join() === 0);
+            done();
+        });
+    });
+
+    var source = 'var sender = __uv_bindings.async_sender(' + async.id() + ');' +
+        'for (var i=0 ; i<100 ; ++i) { sender.send(new Uint8Array(16)); }';
+
+    var worker = uv.worker_spawn(source, 'worker-async');
+});
+
+test('closed sender', function() {
+    var async = uv.async_init(uv.default_loop(), function() {});
+    var id = async.id();
+
+    async.close(function() {
+        var threw = false;
+        try {
+            uv.async_sender(id);
+        }
+        catch (err) {
+            threw = err.code === 'ENOENT';
+        }
+        assert(threw);
+    });
+
+    // a second close throws instead of reaching libuv
+    var threw = false;
+    try {
+        async.close(function() {});
+    }
+    catch (err) {
+        threw = true;
+    }
+    assert(threw);
+});
+
+test('transfer', function(done) {
+    var payload = new ArrayBuffer(1024 * 1024);
+    new Uint8Array(payload)[42] = 7;
+
+    var async = uv.async_init(uv.default_loop(), function(messages) {
+        assert(messages.length === 1);
+
+        // same bytes, now owned by this side
+        var msg = messages[0];
+        assert(msg.byteLength === 1024 * 1024);
+        assert(new Uint8Array(msg)[42] === 7);
+
+        async.close(function() {
+            done();
+        });
+    });
+
+    assert(async.send(payload, true) === 0);
+
+    // the sender no longer has access to the memory
+    assert(payload.byteLength === 0);
+});
+
+test('transfer - mapped file', function(done) {
+    var fd = uv.fs_open(uv.default_loop(), './test/support/fs/foo.txt', uv.O_RDONLY, 0, null);
+    var mapped = uv.fs_mmap(fd, null, null, uv.UVJS_MMAP_READ);
+    uv.fs_close(uv.default_loop(), fd, null);
+
+    var async = uv.async_init(uv.default_loop(), function(messages) {
+        // only the copy arrives
+        assert(messages.length === 1);
+        assert(messages[0].byteLength === 10);
+        assert(new Uint8Array(messages[0])[0] === 115);
+
+        assert(uv.fs_munmap(mapped) === 0);
+        async.close(function() {
+            done();
+        });
+    });
+
+    // mappings are not allocator memory, they can only be copied
+    assert(uv.err_name(async.send(mapped, true)) === 'EINVAL');
+    assert(mapped.byteLength === 10);
+
+    assert(async.send(mapped) === 0);
+});
+
+test('transfer - pinned', function(done) {
+    var path = '/tmp/uvjs-async-pinned.tmp';
+    var fd = uv.fs_open(uv.default_loop(), path, uv.O_RDWR | uv.O_CREAT | uv.O_TRUNC, 438, null);
+
+    var payload = new ArrayBuffer(1024);
+
+    var async = uv.async_init(uv.default_loop(), function(messages) {
+        assert(messages.length === 1);
+        assert(messages[0].byteLength === 1024);
+
+        async.close(function() {
+            done();
+        });
+    });
+
+    uv.fs_write(uv.default_loop(), fd, payload, 0, function(err, written) {
+        assert.ifError(err);
+        assert(written === 1024);
+        uv.fs_close(uv.default_loop(), fd, null);
+
+        // the write is done with it
+        assert(async.send(payload, true) === 0);
+        assert(payload.byteLength === 0);
+    });
+
+    // the threadpool still writes from it
+    assert(uv.err_name(async.send(payload, true)) === 'EBUSY');
+    assert(payload.byteLength === 1024);
+});
@@ -101,3 +101,132 @@ test('fs_readdir', function(done) {
     });
 });
 
+
+test('fs_write', function(done) {
+    var path = '/tmp/uvjs-fs-write.tmp';
+    var flags = uv.O_RDWR | uv.O_CREAT | uv.O_TRUNC;
+    var fd = uv.fs_open(default_loop, path, flags, mode_num('0644'), null);
+
+    // both buffers go out in a single write
+    var head = new Uint8Array([104, 101, 108]); // hel
+    var tail = new Uint8Array([108, 111]).buffer; // lo
+    var written = uv.fs_write(default_loop, fd, [head, tail], 0, null);
+    assert(written === 5);
+
+    // positional, past the end of the file
+    uv.fs_write(default_loop, fd, new Uint8Array([33]).buffer, 5, function(err, written) {
+        assert.ifError(err);
+        assert(written === 1);
+
+        var buf = new ArrayBuffer(16);
+        var len = uv.fs_read(default_loop, fd, buf, 0, null);
+        assert(len === 6);
+        assert(new StringView(buf, 'utf-8', 0, len).toString() === 'hello!');
+
+        uv.fs_close(default_loop, fd, null);
+        done();
+    });
+});
+
+test('fs_read - reused buffer window', function(done) {
+    var fd = uv.fs_open(default_loop, './test/support/fs/foo.txt', 0, mode_num('0666'), null);
+    var buf = new ArrayBuffer(32);
+
+    // the same buffer is read into twice, the second time at an offset
+    var len = uv.fs_read(default_loop, fd, buf, 0, 4, 0, null);
+    assert(len === 4);
+
+    uv.fs_read(default_loop, fd, buf, 4, 4, 5, function(err, nread) {
+        assert.ifError(err);
+        assert(nread === 4);
+
+        assert(new StringView(buf, 'utf-8', 0, 8).toString() === 'sometext');
+
+        uv.fs_close(default_loop, fd, null);
+        done();
+    });
+});
+
+test('fs_read_file', function(done) {
+    done = after(2, done);
+
+    test_fs_fn(uv.fs_read_file, default_loop, './test/support/fs/foo.txt', function(err, buf) {
+        assert.ifError(err);
+        assert(buf instanceof ArrayBuffer);
+        assert(buf.byteLength === 10);
+        assert(new StringView(buf, 'utf-8', 0, 10).toString() === 'some text\n');
+        done();
+    });
+});
+
+test('fs_mmap', function() {
+    var fd = uv.fs_open(default_loop, './test/support/fs/foo.txt', uv.O_RDONLY, 0, null);
+
+    var buf = uv.fs_mmap(fd, 5, null, uv.UVJS_MMAP_READ, uv.UVJS_MADV_SEQUENTIAL);
+    assert(buf.byteLength === 5);
+    assert(new StringView(buf, 'utf-8', 0, 5).toString() === 'text\n');
+
+    // private mapping, writes never reach the file
+    new Uint8Array(buf)[0] = 84;
+    var file = uv.fs_read_file(default_loop, './test/support/fs/foo.txt', null);
+    assert(new StringView(file, 'utf-8', 0, 10).toString() === 'some text\n');
+
+    assert(uv.fs_madvise(buf, uv.UVJS_MADV_WILLNEED) === 0);
+    assert(uv.fs_munmap(buf) === 0);
+    assert(buf.byteLength === 0);
+
+    // not a mapping
+    assert(uv.fs_munmap(new ArrayBuffer(8)) < 0);
+
+    uv.fs_close(default_loop, fd, null);
+});
+
+test('fs_munmap - pending write', function(done) {
+    var fd = uv.fs_open(default_loop, './test/support/fs/foo.txt', uv.O_RDONLY, 0, null);
+    var buf = uv.fs_mmap(fd, null, null, uv.UVJS_MMAP_READ);
+    uv.fs_close(default_loop, fd, null);
+
+    var path = '/tmp/uvjs-fs-munmap.tmp';
+    var out = uv.fs_open(default_loop, path, uv.O_RDWR | uv.O_CREAT | uv.O_TRUNC, mode_num('0666'), null);
+
+    uv.fs_write(default_loop, out, buf, 0, function(err, written) {
+        assert.ifError(err);
+        assert(written === 10);
+        uv.fs_close(default_loop, out, null);
+
+        assert(uv.fs_munmap(buf) === 0);
+        done();
+    });
+
+    // the threadpool still reads the pages
+    assert(uv.err_name(uv.fs_munmap(buf)) === 'EBUSY');
+    assert(buf.byteLength === 10);
+});
+
+test('fs_stat', function(done) {
+    done = after(2, done);
+
+    // one array for every call
+    var stats = new Float64Array(uv.UVJS_STAT_LENGTH);
+
+    test_fs_fn(uv.fs_stat, default_loop, './test/support/fs/foo.txt', stats, function(err) {
+        assert.ifError(err);
+        assert(stats[uv.UVJS_STAT_SIZE] === 10);
+        assert(stats[uv.UVJS_STAT_MTIME] > 0);
+        done();
+    });
+});
+
+test('fs_fstat', function() {
+    var stats = new Float64Array(uv.UVJS_STAT_LENGTH);
+    var fd = uv.fs_open(default_loop, './test/support/fs/foo.txt', uv.O_RDONLY, 0, null);
+
+    assert(uv.fs_fstat(default_loop, fd, stats, null) === 0);
+    assert(stats[uv.UVJS_STAT_SIZE] === 10);
+
+    uv.fs_close(default_loop, fd, null);
+
+    assert.throws(function() {
+        uv.fs_lstat(default_loop, './test/support/fs/missing.txt', stats, null);
+    });
+});
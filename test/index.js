@@ -7,6 +7,8 @@ require('./timer');
 require('./fs');
 require('./stream');
 require('./tcp');
+require('./worker');
+require('./async');
 
 // launch our loop, without this some tests won't run
 var loop = uv.default_loop();
@@ -20,3 +20,98 @@ test('enums', function() {
     assert(uv.UV_LEAVE_GROUP === 0);
     assert(uv.UV_JOIN_GROUP === 1);
 });
+
+test('metrics', function(done) {
+    var loop = uv.default_loop();
+    var metrics = uv.metrics_start(loop);
+
+    assert(metrics instanceof Float64Array);
+
+    var timer = uv.timer_init(loop);
+    timer.start(20, 0, function() {
+        timer.close(function() {
+            assert(metrics[uv.UVJS_METRICS_ITERATIONS] > 0);
+            assert(metrics[uv.UVJS_METRICS_CALLBACKS] > 0);
+
+            // every iteration lands in exactly one bucket of each histogram
+            var offset = uv.UVJS_METRICS_HISTOGRAMS +
+                uv.UVJS_METRICS_HIST_POLL * uv.UVJS_METRICS_BUCKETS;
+            var count = 0;
+            for (var i=0 ; i<uv.UVJS_METRICS_BUCKETS ; ++i) {
+                count += metrics[offset + i];
+            }
+            assert(count > 0);
+
+            // the timer callback ran in the timer phase
+            offset = uv.UVJS_METRICS_HISTOGRAMS +
+                uv.UVJS_METRICS_HIST_JS_TIMER * uv.UVJS_METRICS_BUCKETS;
+            count = 0;
+            for (var i=0 ; i<uv.UVJS_METRICS_BUCKETS ; ++i) {
+                count += metrics[offset + i];
+            }
+            assert(count > 0);
+            assert(metrics[uv.UVJS_METRICS_JS_TIMER_TIME] >= 0);
+            assert(metrics[uv.UVJS_METRICS_JS_CHECK_TIME] >= 0);
+            assert(metrics[uv.UVJS_METRICS_JS_CLOSE_TIME] >= 0);
+
+            uv.metrics_stop(loop);
+            done();
+        });
+    });
+});
+
+test('watchdog', function(done) {
+    var loop = uv.default_loop();
+    var report;
+
+    assert(uv.watchdog_start(loop, 50, function(r) {
+        report = r;
+    }) === 0);
+
+    var timer = uv.timer_init(loop);
+    timer.start(10, 0, function() {
+        // block the loop well past the watchdog timeout
+        var start = Date.now();
+        while (Date.now() - start < 200) {}
+
+        timer.start(100, 0, function() {
+            uv.watchdog_stop(loop);
+            timer.close(function() {
+                assert(report);
+                assert(report.indexOf('loop blocked') === 0);
+                assert(report.indexOf('timer') > 0);
+                done();
+            });
+        });
+    });
+});
+
+test('walk', function(done) {
+    var loop = uv.default_loop();
+
+    var timer = uv.timer_init(loop);
+    timer.start(1000, 0, function() {});
+
+    var found = uv.walk(loop).filter(function(handle) {
+        return handle.type === 'timer' && handle.active && handle.refs > 0;
+    });
+    assert(found.length > 0);
+
+    var server = uv.tcp_init(loop);
+    server.bind({ port: 8085, family: 'IPv4', address: '0.0.0.0' });
+    server.listen(0, function() {});
+
+    var tcp = uv.walk(loop).filter(function(handle) {
+        return handle.type === 'tcp' && handle.listen_cb;
+    });
+    assert(tcp.length === 1);
+    assert(tcp[0].bytes_read === 0);
+    assert(tcp[0].writes_pending === 0);
+
+    timer.stop();
+    timer.close(function() {
+        server.close(function() {
+            done();
+        });
+    });
+});
@@ -1,20 +1,29 @@
 #pragma once
 
+#include <assert.h>
 #include <v8.h>
 #include <uvjs.h>
 
 // baton keeps memory alive for the duration of the array buffer
 class ArrayWatchdog {
 public:
-    ArrayWatchdog(v8::Local<v8::ArrayBuffer>& ab, void* data)
-        : _data(data) {
+    ArrayWatchdog(v8::Local<v8::ArrayBuffer>& ab, void* data,
+            uvjs::ArrayBufferAllocator::ReleaseCallback release = NULL, size_t len = 0)
+        : _data(data), _release(release), _len(len), _pins(0) {
         _array_buffer.Reset(v8::Isolate::GetCurrent(), ab);
         _array_buffer.SetWeak(this, WeakCallback);
     }
 
     ~ArrayWatchdog() {
-        assert(_data);
-        free(_data);
+        // released memory belongs to someone else now
+        if (_data) {
+            if (_release) {
+                _release(_data, _len);
+            }
+            else {
+                free(_data);
+            }
+        }
         _data = NULL;
     }
 
@@ -22,6 +31,27 @@ public:
         return _data;
     }
 
+    // native users of the memory, see uvjs::ArrayBufferAllocator::Pin
+    void pin() {
+        ++_pins;
+    }
+
+    void unpin() {
+        assert(_pins > 0);
+        --_pins;
+    }
+
+    bool pinned() const {
+        return _pins > 0;
+    }
+
+    // stop owning the memory, it is no longer freed with the array buffer
+    void* release() {
+        void* data = _data;
+        _data = NULL;
+        return data;
+    }
+
 private:
 
     static void WeakCallback(const v8::WeakCallbackData<v8::ArrayBuffer, ArrayWatchdog>& data) {
@@ -35,6 +65,9 @@ private:
     }
 
     void* _data;
+    uvjs::ArrayBufferAllocator::ReleaseCallback _release;
+    size_t _len;
+    size_t _pins;
     v8::Persistent<v8::ArrayBuffer> _array_buffer;
 };
 
@@ -80,5 +113,50 @@ public:
         return scope.Close(arr);
     }
 
+    v8::Local<v8::ArrayBuffer> Externalize(void* buf, size_t bytes, ReleaseCallback release) {
+        v8::HandleScope scope(v8::Isolate::GetCurrent());
+
+        v8::Local<v8::ArrayBuffer> arr = v8::ArrayBuffer::New(buf, bytes);
+
+        ArrayWatchdog* baton = new ArrayWatchdog(arr, buf, release, bytes);
+        arr->SetAlignedPointerInInternalField(kExternalField, baton);
+
+        return scope.Close(arr);
+    }
+
+    void* Release(v8::Local<v8::ArrayBuffer>& buffer) {
+        // never externalized, nobody owns the contents yet
+        if (!buffer->IsExternal()) {
+            return buffer->Externalize().Data();
+        }
+
+        ArrayWatchdog* baton = static_cast<ArrayWatchdog*>(buffer->GetAlignedPointerFromInternalField(kExternalField));
+        return baton->release();
+    }
+
+    void Pin(v8::Local<v8::ArrayBuffer>& buffer) {
+        Externalized(buffer);
+
+        ArrayWatchdog* baton = static_cast<ArrayWatchdog*>(buffer->GetAlignedPointerFromInternalField(kExternalField));
+        baton->pin();
+    }
+
+    void Unpin(v8::Local<v8::ArrayBuffer>& buffer) {
+        assert(buffer->IsExternal());
+
+        ArrayWatchdog* baton = static_cast<ArrayWatchdog*>(buffer->GetAlignedPointerFromInternalField(kExternalField));
+        baton->unpin();
+    }
+
+    bool Pinned(v8::Local<v8::ArrayBuffer>& buffer) {
+        // never externalized, nothing native knows about it
+        if (!buffer->IsExternal()) {
+            return false;
+        }
+
+        ArrayWatchdog* baton = static_cast<ArrayWatchdog*>(buffer->GetAlignedPointerFromInternalField(kExternalField));
+        return baton->pinned();
+    }
+
 };
 
@@ -15,12 +15,16 @@
 #include "Allocator.h"
 
 v8::Handle<v8::Context> CreateShellContext(v8::Isolate* isolate, int argc, char* argv[]);
+v8::Handle<v8::ObjectTemplate> WorkerGlobal();
 int RunMain(v8::Isolate* isolate, int argc, char* argv[]);
 bool ExecuteString(v8::Handle<v8::String> source, v8::Handle<v8::Value> name);
 void Print(const v8::FunctionCallbackInfo<v8::Value>& args);
 void Read(const v8::FunctionCallbackInfo<v8::Value>& args);
 void RunInThisContext(const v8::FunctionCallbackInfo<v8::Value>& args);
 void Quit(const v8::FunctionCallbackInfo<v8::Value>& args);
+#if defined(UVJS_BENCH)
+void Noop(const v8::FunctionCallbackInfo<v8::Value>& args);
+#endif
 v8::Handle<v8::String> ReadFile(const char* name);
 void ReportException(v8::Isolate* isolate, v8::TryCatch* handler);
 
@@ -36,12 +40,18 @@ int main(int argc, char* argv[]) {
     // no, we need a non-stupid way to get at the array buffer contents
     uvjs::SetArrayBufferAllocator(&allocator);
 
+    // workers get print in addition to the uv bindings
+    uvjs::SetWorkerGlobalCallback(WorkerGlobal);
+
     v8::V8::InitializeICU();
     v8::V8::SetFlagsFromCommandLine(&argc, argv, true);
 
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     int result;
     {
+        // workers lock their own isolates, once any isolate has been locked v8
+        // insists on a Locker for every isolate, this one included
+        v8::Locker locker(isolate);
         v8::HandleScope handle_scope(isolate);
         v8::Handle<v8::Context> context = CreateShellContext(isolate, argc, argv);
 
@@ -65,10 +75,10 @@ int main(int argc, char* argv[]) {
         result = RunMain(isolate, argc, argv);
 
         context->Exit();
-    }
 
-    // force garbage collection on exit
-    while(!v8::V8::IdleNotification()) {};
+        // force garbage collection on exit
+        while(!v8::V8::IdleNotification()) {};
+    }
 
     v8::V8::Dispose();
     return result;
@@ -94,6 +104,16 @@ v8::Handle<v8::Context> CreateShellContext(v8::Isolate* isolate, int argc, char*
     return v8::Context::New(isolate, NULL, global);
 }
 
+// Global object for worker threads.
+v8::Handle<v8::ObjectTemplate> WorkerGlobal() {
+    v8::Handle<v8::ObjectTemplate> global = v8::ObjectTemplate::New();
+
+    global->Set(v8::String::New("print"), v8::FunctionTemplate::New(Print));
+    global->Set(v8::String::New("__uv_bindings"), uvjs::New());
+
+    return global;
+}
+
 void Print(const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::HandleScope handle_scope(args.GetIsolate());
     for (int i = 0; i < args.Length(); i++) {
@@ -141,6 +161,9 @@ void RunInThisContext(const v8::FunctionCallbackInfo<v8::Value>& args) {
         v8::Local<v8::Object> obj = v8::Local<v8::Object>::Cast(args[2]);
         tmpl->Set(v8::String::New("global"), obj);
         tmpl->Set(v8::String::New("print"), v8::FunctionTemplate::New(Print));
+#if defined(UVJS_BENCH)
+        tmpl->Set(v8::String::New("noop"), v8::FunctionTemplate::New(Noop));
+#endif
 
         v8::Handle<v8::Context> ctx = v8::Context::New(args.GetIsolate(), NULL, tmpl);
         ctx->Enter();
@@ -167,6 +190,13 @@ void Quit(const v8::FunctionCallbackInfo<v8::Value>& args) {
     exit(exit_code);
 }
 
+#if defined(UVJS_BENCH)
+// Empty native function, the baseline for binding call overhead in bench/calls.js
+// The bench target builds this shell with UVJS_BENCH defined.
+void Noop(const v8::FunctionCallbackInfo<v8::Value>& args) {
+}
+#endif
+
 // Reads a file into a v8 string.
 v8::Handle<v8::String> ReadFile(const char* name) {
     std::string src;
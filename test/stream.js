@@ -2,9 +2,55 @@ var test = require('./support/test');
 var assert = require('./support/assert');
 var after = require('./support/after');
 var uv = require('./support/uv');
+var StringView = require('./support/StringView');
+var TextEncoder = require('./support/encoding').TextEncoder;
 
+var encoder = new TextEncoder('utf-8');
 var default_loop = uv.default_loop();
 
+// cb(client, conn) with both ends of a connection, the listener is closed
+function socket_pair(port, cb) {
+    var server = uv.tcp_init(default_loop);
+    server.bind({ port: port, family: 'IPv4', address: '127.0.0.1' });
+
+    var client = uv.tcp_init(default_loop);
+    var conn;
+
+    var connected = after(2, function() {
+        server.close(function() {});
+        cb(client, conn);
+    });
+
+    server.listen(0, function() {
+        conn = server.accept();
+        connected();
+    });
+
+    client.connect({ address: '127.0.0.1', port: port, family: 'IPv4' }, function() {
+        connected();
+    });
+}
+
+// write buf count times, cb once every write completed
+function write_all(stream, buf, count, cb) {
+    var pending = 1;
+    var written = function() {
+        if (--pending === 0) {
+            cb();
+        }
+    };
+
+    for (var i = 0 ; i < count ; ++i) {
+        var err = stream.write(buf, written);
+        assert(err === 0 || err === uv.UVJS_WRITE_DONE);
+        if (err === 0) {
+            ++pending;
+        }
+    }
+
+    written();
+}
+
 test('stream', function(done) {
     var tcp_handle = uv.tcp_init(default_loop);
 
@@ -27,3 +73,481 @@ test('stream', function(done) {
     });
 });
 
+
+test('write_queue_size', function(done) {
+    done = after(2, done);
+
+    var high = 1024 * 1024;
+    var low = 64 * 1024;
+    var chunk = new ArrayBuffer(64 * 1024);
+
+    var server = uv.tcp_init(default_loop);
+    server.bind({ port: 8089, family: 'IPv4', address: '127.0.0.1' });
+
+    var client = uv.tcp_init(default_loop);
+    var conn;
+    var drained = 0;
+
+    // nothing queued on a fresh handle
+    assert(client.write_queue_size() === 0);
+
+    var on_read = function(err, data) {
+        if (err || !data) {
+            conn.close(function() {});
+            server.close(function() {
+                done();
+            });
+        }
+    };
+
+    // once connected and accepted, write until we are over the high watermark
+    var fill = after(2, function() {
+        client.set_watermarks(high, low, function() {
+            ++drained;
+            assert(client.write_queue_size() <= low);
+
+            client.close(function() {
+                assert(drained === 1);
+                done();
+            });
+        });
+
+        // the server is paused, the socket buffers fill up and writes queue
+        for (var i = 0 ; i < 4096 && client.write_queue_size() <= high ; ++i) {
+            var err = client.write(chunk, function() {});
+            assert(err === 0 || err === uv.UVJS_WRITE_DONE);
+        }
+
+        assert(client.write_queue_size() > high);
+        assert(drained === 0);
+
+        // resume reading on the server, drain fires once the queue is down to low
+        assert(conn.read_start(on_read) === 0);
+    });
+
+    server.listen(0, function() {
+        conn = server.accept();
+
+        // pause right away
+        assert(conn.read_start(on_read) === 0);
+        assert(conn.read_stop() === 0);
+        fill();
+    });
+
+    client.connect({ address: '127.0.0.1', port: 8089, family: 'IPv4' }, fill);
+});
+
+test('listen_all', function(done) {
+    var count = 4;
+    var tcp_handle = uv.tcp_init(default_loop);
+
+    var err = tcp_handle.bind({
+        port: 8081,
+        family: 'IPv4',
+        address: '127.0.0.1'
+    });
+    assert(err == 0);
+
+    var clients = [];
+    var accepted = [];
+    var closed = after(2 * count + 1, done);
+
+    // connections are delivered in batches, a burst usually lands in one
+    // callback but may be split across poll iterations
+    var err = tcp_handle.listen_all(16, function(status, batch) {
+        assert(status === 0);
+        assert(batch.length > 0);
+
+        accepted = accepted.concat(batch);
+        if (accepted.length < count) {
+            return;
+        }
+
+        assert(accepted.length === count);
+        accepted.concat(clients).forEach(function(handle) {
+            handle.close(closed);
+        });
+        tcp_handle.close(closed);
+    });
+    assert(err === 0);
+
+    // all connect at once
+    for (var i = 0 ; i < count ; ++i) {
+        var client = uv.tcp_init(default_loop);
+        client.connect({ address: '127.0.0.1', port: 8081, family: 'IPv4' }, function() {});
+        clients.push(client);
+    }
+});
+
+test('set_timeout', function(done) {
+    var server = uv.tcp_init(default_loop);
+    server.bind({ port: 8084, family: 'IPv4', address: '127.0.0.1' });
+
+    var start;
+
+    // the accepted client never sends anything
+    server.listen(0, function() {
+        var conn = server.accept();
+        conn.read_start(function() {});
+
+        start = Date.now();
+        var err = conn.set_timeout(100, function() {
+            var delta = Date.now() - start;
+            assert(delta >= 95);
+
+            conn.close(function() {});
+            client.close(function() {});
+            server.close(function() {
+                done();
+            });
+        });
+        assert(err === 0);
+    });
+
+    var client = uv.tcp_init(default_loop);
+    client.connect({ address: '127.0.0.1', port: 8084, family: 'IPv4' }, function() {});
+});
+
+// bytes of a frame as a string
+function frame_string(frame) {
+    var str = '';
+    for (var i = 0 ; i < frame.length ; ++i) {
+        str += String.fromCharCode(frame[i]);
+    }
+    return str;
+}
+
+// write chunks (strings or arrays of bytes) to a server reading with framing
+// cb(calls) with every read callback made, eof included
+function framed_reads(port, framing, chunks, cb) {
+    socket_pair(port, function(client, conn) {
+        var calls = [];
+
+        conn.read_start(framing, function(err, frames) {
+            if (err) {
+                calls.push({ error: err.message, data: err.data && frame_string(err.data) });
+            }
+            else if (!frames) {
+                calls.push({ eof: true });
+            }
+            else {
+                calls.push({ frames: frames.map(frame_string) });
+            }
+        });
+
+        // far enough apart to arrive as separate reads
+        var timer = uv.timer_init(default_loop);
+
+        var next = function() {
+            var chunk = chunks.shift();
+
+            if (chunk === undefined) {
+                client.close(function() {});
+                timer.start(50, 0, function() {
+                    timer.close(function() {});
+                    conn.close(function() {
+                        cb(calls);
+                    });
+                });
+                return;
+            }
+
+            var buf = typeof chunk === 'string' ? encoder.encode(chunk) : new Uint8Array(chunk);
+            write_all(client, buf.buffer, 1, function() {
+                timer.start(10, 0, next);
+            });
+        };
+
+        next();
+    });
+}
+
+// frames of all calls in order
+function all_frames(calls) {
+    var frames = [];
+    calls.forEach(function(call) {
+        frames = frames.concat(call.frames || []);
+    });
+    return frames;
+}
+
+test('read_start - delimiter framing', function(done) {
+    framed_reads(8098, { delimiter: 10 }, ['one\ntw', 'o\n\nthr', 'ee'], function(calls) {
+        assert(all_frames(calls).join(',') === 'one,two,');
+
+        // the last line has no delimiter, it is reported before eof
+        var last = calls.slice(-2);
+        assert(last[0].error === 'partial frame at eof');
+        assert(last[0].data === 'three');
+        assert(last[1].eof);
+        done();
+    });
+});
+
+test('read_start - length prefix framing', function(done) {
+    done = after(2, done);
+
+    // big endian, frames and headers split across reads
+    framed_reads(8099, { length_prefix: 2 }, [[0, 3, 97], [98, 99, 0], [0, 0, 1, 122]],
+            function(calls) {
+        assert(all_frames(calls).join(',') === 'abc,,z');
+        assert(calls[calls.length - 1].eof);
+        assert(calls.every(function(call) { return !call.error; }));
+        done();
+    });
+
+    framed_reads(8100, { length_prefix: 4, little_endian: true }, [[2, 0, 0, 0, 104, 105]],
+            function(calls) {
+        assert(all_frames(calls).join(',') === 'hi');
+        assert(calls[calls.length - 1].eof);
+        done();
+    });
+});
+
+test('read_start - fixed size framing', function(done) {
+    framed_reads(8101, { frame_size: 4 }, ['abcdef', 'gh', 'ij'], function(calls) {
+        assert(all_frames(calls).join(',') === 'abcd,efgh');
+
+        var last = calls.slice(-2);
+        assert(last[0].error === 'partial frame at eof');
+        assert(last[0].data === 'ij');
+        assert(last[1].eof);
+        done();
+    });
+});
+
+test('read_start - frame too large', function(done) {
+    // the prefix announces 4GB, nothing after it is delivered
+    framed_reads(8102, { length_prefix: 4 }, [[255, 255, 255, 255, 1], 'more data'],
+            function(calls) {
+        assert(calls.length === 1);
+        assert(calls[0].error === 'frame too large');
+        done();
+    });
+});
+
+test('pipe', function(done) {
+    socket_pair(8090, function(a_client, a_conn) {
+        socket_pair(8091, function(b_client, b_conn) {
+            var received = '';
+
+            b_conn.read_start(function(err, data) {
+                assert.ifError(err);
+
+                if (!data) {
+                    assert(received === 'hello pipe');
+                    b_conn.close(function() {
+                        done();
+                    });
+                    return;
+                }
+
+                received += new StringView(data).toString();
+            });
+
+            // reads started from js are taken over by the pipe
+            assert(a_conn.read_start(function() { assert(false); }) === 0);
+
+            var err = a_conn.pipe(b_client, function(status) {
+                assert(status === 0);
+
+                a_conn.close(function() {});
+                b_client.close(function() {});
+            });
+            assert(err === 0);
+
+            assert(uv.err_name(a_conn.read_start(function() {})) === 'EBUSY');
+
+            write_all(a_client, encoder.encode('hello pipe').buffer, 1, function() {
+                a_client.close(function() {});
+            });
+        });
+    });
+});
+
+test('pipe - backpressure', function(done) {
+    var chunk = new ArrayBuffer(64 * 1024);
+    var count = 512;
+
+    socket_pair(8092, function(a_client, a_conn) {
+        socket_pair(8093, function(b_client, b_conn) {
+            var received = 0;
+
+            var on_read = function(err, data) {
+                assert.ifError(err);
+
+                if (!data) {
+                    assert(received === count * chunk.byteLength);
+                    b_conn.close(function() {
+                        done();
+                    });
+                    return;
+                }
+
+                received += data.byteLength;
+            };
+
+            // the destination does not read yet
+            assert(b_conn.read_start(on_read) === 0);
+            assert(b_conn.read_stop() === 0);
+
+            var err = a_conn.pipe(b_client, function(status) {
+                assert(status === 0);
+
+                a_conn.close(function() {});
+                b_client.close(function() {});
+            });
+            assert(err === 0);
+
+            // more than the socket buffers of both connections hold
+            write_all(a_client, chunk, count, function() {
+                a_client.close(function() {});
+            });
+
+            var timer = uv.timer_init(default_loop);
+            timer.start(100, 0, function() {
+                // the pipe stopped reading instead of queuing everything
+                assert(b_client.write_queue_size() < 512 * 1024);
+                assert(a_client.write_queue_size() > 0);
+
+                timer.close(function() {});
+                assert(b_conn.read_start(on_read) === 0);
+            });
+        });
+    });
+});
+
+test('pipe - close during pipe', function(done) {
+    done = after(2, done);
+
+    // closing the destination
+    socket_pair(8094, function(a_client, a_conn) {
+        socket_pair(8095, function(b_client, b_conn) {
+            var err = a_conn.pipe(b_client, function(status) {
+                assert(uv.err_name(status) === 'ECANCELED');
+
+                // the pipe let go of the source, js can read from it again
+                assert(a_conn.read_start(function() {}) === 0);
+
+                a_client.close(function() {});
+                a_conn.close(function() {});
+                b_conn.close(function() {
+                    done();
+                });
+            });
+            assert(err === 0);
+
+            b_client.close(function() {});
+        });
+    });
+
+    // closing the source
+    socket_pair(8096, function(a_client, a_conn) {
+        socket_pair(8097, function(b_client, b_conn) {
+            var err = a_conn.pipe(b_client, function(status) {
+                assert(uv.err_name(status) === 'ECANCELED');
+
+                a_client.close(function() {});
+                b_client.close(function() {});
+                b_conn.close(function() {
+                    done();
+                });
+            });
+            assert(err === 0);
+
+            a_conn.close(function() {});
+        });
+    });
+});
+
+test('pipe - close source with writes queued', function(done) {
+    var chunk = new ArrayBuffer(64 * 1024);
+    var count = 512;
+
+    socket_pair(8103, function(a_client, a_conn) {
+        socket_pair(8104, function(b_client, b_conn) {
+            var received = 0;
+
+            // the destination does not read yet, writes queue up on b_client
+            var on_read = function(err, data) {
+                assert.ifError(err);
+                if (data) {
+                    received += data.byteLength;
+                }
+            };
+
+            assert(b_conn.read_start(on_read) === 0);
+            assert(b_conn.read_stop() === 0);
+
+            var err = a_conn.pipe(b_client, function(status) {
+                assert(uv.err_name(status) === 'ECANCELED');
+
+                // everything read before the close was still written
+                assert(b_client.write_queue_size() === 0);
+
+                a_client.close(function() {});
+                b_client.close(function() {});
+                b_conn.close(function() {
+                    done();
+                });
+            });
+            assert(err === 0);
+
+            // more than the socket buffers of both connections hold
+            write_all(a_client, chunk, count, function() {});
+
+            var timer = uv.timer_init(default_loop);
+            timer.start(100, 0, function() {
+                timer.close(function() {});
+                assert(b_client.write_queue_size() > 0);
+
+                // the pipe lets go of the source, it can be collected before
+                // the queued writes complete
+                a_conn.close(function() {
+                    a_conn = null;
+                    gc();
+
+                    assert(b_conn.read_start(on_read) === 0);
+                });
+            });
+        });
+    });
+});
+
+test('read_start - slab data is not transferable', function(done) {
+    socket_pair(8105, function(client, conn) {
+        var async = uv.async_init(default_loop, function(messages) {
+            assert(false);
+        });
+
+        conn.read_start(function(err, data) {
+            assert.ifError(err);
+
+            // the slab holds the reads of every stream on the loop
+            assert(uv.err_name(async.send(data.buffer, true)) === 'EBUSY');
+            assert(data.byteLength === 4);
+
+            client.close(function() {});
+            conn.close(function() {});
+            async.close(function() {
+                done();
+            });
+        });
+
+        write_all(client, new Uint8Array([1, 2, 3, 4]).buffer, 1, function() {});
+    });
+});
+
+test('read_stop - after close', function(done) {
+    socket_pair(8106, function(client, conn) {
+        assert(conn.read_start(function() {}) === 0);
+
+        client.close(function() {});
+        conn.close(function() {
+            // close already released the reading reference
+            conn.read_stop();
+            gc();
+            done();
+        });
+    });
+});
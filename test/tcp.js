@@ -9,6 +9,29 @@ var encoder = new TextEncoder('utf-8');
 
 var tcp_handle;
 
+// server answering every read with reply(client, data), gone after the first eof
+function pong_server(port, reply) {
+    var server = uv.tcp_init(uv.default_loop());
+
+    var err = server.bind({ port: port, family: 'IPv4', address: '127.0.0.1' });
+    assert(err === 0);
+
+    var err = server.listen(0, function() {
+        var client = server.accept();
+
+        client.read_start(function(err, data) {
+            if (err || !data) {
+                client.close(function() {});
+                server.close(function() {});
+                return;
+            }
+
+            reply(client, data);
+        });
+    });
+    assert(err === 0);
+}
+
 test('init', function() {
     tcp_handle = uv.tcp_init(uv.default_loop());
 });
@@ -38,6 +61,10 @@ test('listen', function(done) {
                 return;
             }
 
+            // reads are views into a shared slab
+            assert(data instanceof Uint8Array);
+            assert(data.byteLength === 4);
+
             var str = new StringView(data);
             assert(str == 'ping');
 
@@ -72,8 +99,121 @@ test('client', function(done) {
             });
         });
 
+        // small writes on an idle socket complete inline
         var buf = encoder.encode('ping').buffer;
         var err = ping_handle.write(buf, function() {
         });
+        assert(err === 0 || err === uv.UVJS_WRITE_DONE);
+    });
+});
+
+test('read_start - ring buffer', function(done) {
+    pong_server(8086, function(client, data) {
+        client.write(encoder.encode('pong').buffer, function() {});
+    });
+
+    var client = uv.tcp_init(uv.default_loop());
+    client.connect({ address: '127.0.0.1', port: 8086, family: 'IPv4'}, function() {
+        // too small for two replies, the second one wraps around
+        var buf = new ArrayBuffer(6);
+        var received = '';
+        var wrapped = false;
+        var last = -1;
+
+        client.read_start(buf, function(err, offset, nread) {
+            assert.ifError(err);
+            assert(offset !== undefined);
+            assert(offset + nread <= buf.byteLength);
+
+            wrapped = wrapped || offset < last;
+            last = offset;
+            received += new StringView(buf, 'utf-8', offset, nread).toString();
+
+            if (received === 'pong') {
+                client.write(encoder.encode('ping').buffer, function() {});
+            }
+            else if (received === 'pongpong') {
+                assert(wrapped);
+                client.close(function() {
+                    done();
+                });
+            }
+        });
+
+        client.write(encoder.encode('ping').buffer, function() {});
+    });
+});
+
+test('write - array of buffers', function(done) {
+    pong_server(8087, function(client, data) {
+        // header and body go out in a single writev
+        var head = encoder.encode('po').buffer;
+        var body = encoder.encode('ng').buffer;
+        var err = client.write([head, body], function(status) {
+            assert(status === 0);
+        });
+        assert(err === 0 || err === uv.UVJS_WRITE_DONE);
+
+        // an encoder may produce nothing at all
+        assert(client.write([], function() { assert(false); }) === uv.UVJS_WRITE_DONE);
+    });
+
+    var client = uv.tcp_init(uv.default_loop());
+    client.connect({ address: '127.0.0.1', port: 8087, family: 'IPv4'}, function() {
+        var received = '';
+
+        client.read_start(function(err, data) {
+            assert.ifError(err);
+            assert(data);
+
+            received += new StringView(data).toString();
+            if (received === 'pong') {
+                client.close(function() {
+                    done();
+                });
+            }
+        });
+
+        client.write(encoder.encode('ping').buffer, function() {});
+    });
+});
+
+test('cork', function(done) {
+    pong_server(8088, function(client, data) {
+        // both corked writes arrive together
+        assert(data.byteLength === 4);
+        assert(new StringView(data) == 'ping');
+
+        client.write(encoder.encode('pong').buffer, function() {});
+    });
+
+    var client = uv.tcp_init(uv.default_loop());
+    client.connect({ address: '127.0.0.1', port: 8088, family: 'IPv4'}, function() {
+        var written = 0;
+
+        client.read_start(function(err, data) {
+            assert.ifError(err);
+            assert(new StringView(data) == 'pong');
+            assert(written === 2);
+
+            client.close(function() {
+                done();
+            });
+        });
+
+        // corked writes go out together at the end of the loop iteration
+        client.cork();
+
+        var err = client.write(encoder.encode('pi').buffer, function(status) {
+            assert(status === 0);
+            ++written;
+        });
+        assert(err === 0);
+
+        var err = client.write(encoder.encode('ng').buffer, function(status) {
+            assert(status === 0);
+            ++written;
+        });
+        assert(err === 0);
     });
 });
@@ -70,3 +70,84 @@ test('repeat', function(done) {
         timeout();
     });
 });
+
+test('shared template', function() {
+    var a = uv.timer_init(default_loop);
+    var b = uv.timer_init(default_loop);
+
+    // instances share function objects from the cached template
+    assert(a.start === b.start);
+    assert(a.close === b.close);
+});
+
+test('timer wheel', function(done) {
+    var start = Date.now();
+
+    var wheel = uv.timer_wheel_init(default_loop, function(tokens) {
+        var delta = Date.now() - start;
+        assert(delta >= 95 && delta < 150);
+
+        // both timeouts for the same tick come in one batch
+        assert(tokens.length === 2);
+        assert(tokens.indexOf(1) >= 0 && tokens.indexOf(3) >= 0);
+
+        // already expired
+        assert(wheel.cancel(first) === false);
+
+        wheel.close(function() {
+            done();
+        });
+    });
+
+    var first = wheel.add(100, 1);
+    var cancelled = wheel.add(50, 2);
+    wheel.add(100, 3);
+
+    assert(wheel.cancel(cancelled) === true);
+    assert(wheel.cancel(cancelled) === false);
+});
+
+test('timer wheel - top level rollover', function(done) {
+    var start = Date.now();
+
+    var wheel = uv.timer_wheel_init(default_loop, function(tokens) {
+        // not parked for a whole revolution of the top level
+        var delta = Date.now() - start;
+        assert(delta >= 95 && delta < 150);
+        assert(tokens.length === 1 && tokens[0] === 7);
+
+        wheel.close(function() {
+            done();
+        });
+    });
+
+    // 10ms before the top level digit (2^24 ticks) rolls over
+    wheel._set_clock(Math.pow(2, 24) - 10);
+    wheel.add(100, 7);
+});
+
+test('timer wheel - close with pending timeouts', function(done) {
+    var wheel = uv.timer_wheel_init(default_loop, function(tokens) {
+        assert(false);
+    });
+
+    var id = wheel.add(50, 1);
+    wheel.add(100, 2);
+
+    wheel.close(function() {
+        // the pending timeouts went away with the wheel
+        assert(wheel.cancel(id) === false);
+
+        var threw = false;
+        try {
+            wheel.add(10, 3);
+        }
+        catch (err) {
+            threw = true;
+        }
+        assert(threw);
+
+        gc();
+        done();
+    });
+});
@@ -0,0 +1,106 @@
+var test = require('./support/test');
+var assert = require('./support/assert');
+var uv = require('./support/uv');
+
+// runs in the worker isolate, nothing from this file is visible there
+var worker_source = function() {
+    var uv = __uv_bindings;
+    var loop = uv.default_loop();
+
+    var server = uv.tcp_init(loop);
+    var err = server.bind({
+        port: 8082,
+        family: 'IPv4',
+        address: '0.0.0.0',
+        reuseport: true
+    });
+
+    if (err) {
+        throw new Error('bind failed: ' + uv.err_name(err));
+    }
+
+    var timer = uv.timer_init(loop);
+    timer.start(10, 0, function() {
+        timer.close(function() {});
+        server.close(function() {});
+    });
+};
+
+test('spawn and join', function() {
+    var source = '(' + worker_source.toString() + ')()';
+
+    var workers = [];
+    for (var i=0 ; i<2 ; ++i) {
+        workers.push(uv.worker_spawn(source, 'worker-' + i));
+    }
+
+    workers.forEach(function(worker) {
+        assert(worker.join() === 0);
+    });
+});
+
+test('script error', function() {
+    var worker = uv.worker_spawn('throw new Error("boom")', 'worker-error');
+    assert(worker.join() === 1);
+});
+
+// echoes one handed off connection, then lets the worker loop finish
+var echo_source = function() {
+    var uv = __uv_bindings;
+
+    var target = uv.handoff_init(uv.default_loop(), 'echo', function(status, clients) {
+        clients.forEach(function(client) {
+            client.read_start(function(err, data) {
+                if (err || !data) {
+                    return client.close(function() {});
+                }
+
+                client.write(data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength),
+                    function() {});
+            });
+        });
+
+        target.close(function() {});
+    });
+};
+
+test('handoff', function(done) {
+    var loop = uv.default_loop();
+    var worker = uv.worker_spawn('(' + echo_source.toString() + ')()', 'worker-echo');
+
+    var server = uv.tcp_init(loop);
+    server.bind({ port: 8083, family: 'IPv4', address: '127.0.0.1' });
+
+    // the worker might not have registered its target yet, the connection
+    // stays pending on the server until it has
+    var retry = uv.timer_init(loop);
+    var handoff = function() {
+        var err = server.handoff('echo', uv.UVJS_HANDOFF_LEAST_LOAD);
+        if (err !== 0) {
+            assert(uv.err_name(err) === 'ENOENT');
+            retry.start(10, 0, handoff);
+            return;
+        }
+
+        retry.close(function() {});
+
+        server.close(function() {});
+    };
+
+    assert(server.listen(1, handoff) === 0);
+
+    var client = uv.tcp_init(loop);
+    client.connect({ address: '127.0.0.1', port: 8083, family: 'IPv4' }, function() {
+        client.read_start(function(err, data) {
+            assert(!err);
+            assert(data.byteLength === 4);
+
+            client.close(function() {
+                assert(worker.join() === 0);
+                done();
+            });
+        });
+
+        client.write(new Uint8Array([1, 2, 3, 4]).buffer, function() {});
+    });
+});
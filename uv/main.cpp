@@ -42,6 +42,9 @@ int main(int argc, char* argv[]) {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     int result = 0;
     {
+        // workers lock their own isolates, once any isolate has been locked v8
+        // insists on a Locker for every isolate, this one included
+        v8::Locker locker(isolate);
         v8::HandleScope handle_scope(isolate);
         v8::Handle<v8::Context> context = CreateShellContext(isolate, argc, argv);
 
@@ -75,10 +78,10 @@ int main(int argc, char* argv[]) {
         }
 
         context->Exit();
-    }
 
-    // force garbage collection on exit
-    while(!v8::V8::IdleNotification()) {};
+        // force garbage collection on exit
+        while(!v8::V8::IdleNotification()) {};
+    }
 
     v8::V8::Dispose();
     return result;
@@ -88,6 +88,33 @@
       ],
     },
 
+    {
+      'target_name': 'bench',
+      'type': 'executable',
+
+      'include_dirs': [
+        'src',
+      ],
+
+      # the test shell with a noop() global for bench/calls.js
+      'sources': [
+        'common.gypi',
+        'test/shell/main.cpp'
+      ],
+
+      'defines': [
+        'ARCH="<(target_arch)"',
+        'PLATFORM="<(OS)"',
+        'UVJS_BENCH',
+      ],
+
+      'dependencies': [
+        'vendor/v8/tools/gyp/v8.gyp:v8',
+        'vendor/uv/uv.gyp:libuv',
+        'libuvjs',
+      ],
+    },
+
     {
       'target_name': 'js2c',
       'type': 'none',